@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+"""
+Cycle counts for the pic16f690 programs under gpsim
+
+Runs the SDCC build (output.hex / output.cod from
+build.sh) of each program in gpsim with a square
+wave on RA2 and RC5, and records:
+
+- cycles per call for each function, from entry
+  to return, less any isr time in between
+- isr entries and cycles per entry, 0x0004 to
+  retfie, min / mean / worst case
+- report cost, cycles per Frequency_report call,
+  the formatting and queueing of one reading
+- usart write cycles by call site, each
+  USART_Write / USART_WriteString call is put
+  down to the function that made it
+- usart throughput, TXREG writes per second
+
+Cycles are turned into time with each program's
+own SYSTEM_CLOCK, read from its main.c.
+
+Results are json, one entry per program, see
+compare.py to check two runs for regressions.
+
+usage:
+  bench.py [--build] [--seconds 2] [--signal-hz 1000]
+           [--out results.json] [program dirs]
+
+Program dirs default to ../timer0 ../timer1
+../blink.  Needs gpsim and gputils (gpdasm) on
+the path.  Function entries come from the gplink
+map file, returns from gpdasm of output.hex.
+
+Written against the gpsim 0.31 docs, the cli is
+driven over a pipe, see Gpsim below if the prompt
+or messages differ in another version.
+
+Not yet run: there are no committed results, and
+the gpsim parsing is untested against a real
+session.  Expect to fix it up on the first run.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+ISR_VECTOR = 0x0004
+TXREG = 0x19
+
+# one reading out, see report_cycles
+REPORT_FUNCTION = "_Frequency_report"
+# usart writes, attributed to their caller
+WRITE_FUNCTIONS = ("_USART_Write", "_USART_WriteString")
+
+# gpsim's message for the TXREG write break, not
+# just any output that says write
+TX_BREAK = re.compile(r"write.*\b(?:txreg|0x0*%x)\b" % TXREG, re.IGNORECASE)
+
+
+def system_clock(program):
+    """fosc from #define SYSTEM_CLOCK in the program's main.c"""
+    pattern = re.compile(r"^#define\s+SYSTEM_CLOCK\s+(\d+)", re.MULTILINE)
+    with open(os.path.join(program, "main.c")) as f:
+        m = pattern.search(f.read())
+    if not m:
+        raise RuntimeError("no SYSTEM_CLOCK in " + program + "/main.c")
+    return int(m.group(1))
+
+
+##################################################
+# symbols
+
+def read_map(path):
+    """program symbols from the gplink map, {name: address}"""
+    symbols = {}
+    pattern = re.compile(r"^\s*(_\w+)\s+0x([0-9a-fA-F]+)\s+program\b")
+    with open(path) as f:
+        for line in f:
+            m = pattern.match(line)
+            if m:
+                symbols[m.group(1)] = int(m.group(2), 16)
+    return symbols
+
+
+def read_returns(hexfile):
+    """addresses of return / retlw / retfie, from gpdasm"""
+    out = subprocess.run(["gpdasm", "-p", "p16f690", hexfile],
+                         capture_output=True, text=True, check=True).stdout
+    returns = {}
+    pattern = re.compile(r"^([0-9a-fA-F]+):\s+[0-9a-fA-F]{4}\s+(return|retlw|retfie)\b")
+    for line in out.splitlines():
+        m = pattern.match(line)
+        if m:
+            returns[int(m.group(1), 16)] = m.group(2)
+    return returns
+
+
+def function_exits(symbols, returns):
+    """{name: [return addresses]}, a function runs to the next symbol"""
+    ordered = sorted(symbols.items(), key=lambda s: s[1])
+    exits = {}
+    for i, (name, start) in enumerate(ordered):
+        end = ordered[i + 1][1] if i + 1 < len(ordered) else 0x1000
+        exits[name] = [a for a, op in returns.items()
+                       if start <= a < end and op != "retfie"]
+    return exits
+
+
+##################################################
+# gpsim cli
+
+class Gpsim:
+    PROMPT = re.compile(r"\*\*gpsim>\s*$")
+    ADDRESS = re.compile(r"(?:address|at)\s+0x([0-9a-fA-F]+)")
+    VALUE = re.compile(r"=\s*(?:0x([0-9a-fA-F]+)|(\d+))")
+
+    def __init__(self, cod, script):
+        self.proc = subprocess.Popen(["gpsim", "-i", "-p", "p16f690", "-s", cod, "-c", script],
+                                     stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT, text=True, bufsize=0)
+        self.read()
+
+    def read(self):
+        text = ""
+        while not self.PROMPT.search(text):
+            c = self.proc.stdout.read(1)
+            if not c:
+                raise RuntimeError("gpsim exited:\n" + text)
+            text += c
+        return text
+
+    def cmd(self, line):
+        self.proc.stdin.write(line + "\n")
+        self.proc.stdin.flush()
+        return self.read()
+
+    def value(self, name):
+        m = self.VALUE.search(self.cmd(name))
+        if not m:
+            raise RuntimeError("no value for " + name)
+        return int(m.group(1), 16) if m.group(1) else int(m.group(2))
+
+    def cycles(self):
+        return self.value("stopwatch.cycles")
+
+    def run(self):
+        """run to the next break, (address or None, message)"""
+        text = self.cmd("run")
+        m = self.ADDRESS.search(text)
+        return (int(m.group(1), 16) if m else None), text
+
+    def quit(self):
+        self.proc.stdin.write("quit\n")
+        self.proc.stdin.flush()
+        self.proc.wait()
+
+
+##################################################
+# stats
+
+class Stat:
+    def __init__(self):
+        self.values = []
+
+    def add(self, v):
+        self.values.append(v)
+
+    def json(self):
+        v = self.values
+        if not v:
+            return {"calls": 0}
+        return {"calls": len(v), "min": min(v), "max": max(v),
+                "mean": round(sum(v) / len(v), 1)}
+
+
+def bench(program, seconds, signal_hz):
+    fosc = system_clock(program)
+    fcy = fosc // 4
+    base = os.path.join(program, "output")
+    symbols = read_map(base + ".map")
+    returns = read_returns(base + ".hex")
+    exits = function_exits(symbols, returns)
+    retfie = [a for a, op in returns.items() if op == "retfie"]
+
+    entries = {a: n for n, a in symbols.items() if n != "_main"}
+    leaves = {}
+    for name, addrs in exits.items():
+        for a in addrs:
+            leaves[a] = name
+
+    # startup script - clock, square wave on RA2
+    # (T0CKI) and RC5 (CCP1), the breakpoints
+    period = max(2, int(fcy / signal_hz))
+    script = ["frequency %d" % fosc,
+              "stopwatch.enable = true",
+              "stimulus asynchronous_stimulus",
+              "initial_state 0",
+              "start_cycle 0",
+              "period %d" % period,
+              "{ 0, 1, %d, 0 }" % (period // 2),
+              "name sig",
+              "end",
+              "node n_sig",
+              "attach n_sig sig porta2 portc5"]
+    for a in sorted(set(entries) | set(leaves) | set(retfie) | {ISR_VECTOR}):
+        script.append("break e 0x%x" % a)
+    script.append("break w TXREG")
+    script.append("break c %d" % int(seconds * fcy))
+
+    with open(base + "_bench.stc", "w") as f:
+        f.write("\n".join(script) + "\n")
+
+    sim = Gpsim(base + ".cod", base + "_bench.stc")
+
+    functions = {n: Stat() for n in symbols if n != "_main"}
+    isr = Stat()
+    calls = {}                  # name -> stack of (entry cycle, isr total at entry)
+    active = {False: [], True: []}  # in isr -> names entered, innermost last
+    writes = {}                 # caller -> Stat of its usart write calls
+    isr_entry = None
+    isr_total = 0
+    tx = []
+
+    while True:
+        address, text = sim.run()
+        now = sim.cycles()
+
+        if now >= seconds * fcy:
+            break
+
+        if TX_BREAK.search(text):
+            tx.append(now)
+        elif address == ISR_VECTOR:
+            isr_entry = now
+        elif address in retfie and isr_entry is not None:
+            isr.add(now - isr_entry)
+            isr_total += now - isr_entry
+            isr_entry = None
+            active[True] = []
+        elif address in entries:
+            calls.setdefault(entries[address], []).append((now, isr_total))
+            active[isr_entry is not None].append(entries[address])
+        elif address in leaves:
+            name = leaves[address]
+            stack = calls.get(name)
+            if stack:
+                start, isr_start = stack.pop()
+                # isr time only counts if this call was not in the isr
+                spent = now - start
+                if isr_entry is None:
+                    spent -= isr_total - isr_start
+                functions[name].add(spent)
+
+                names = active[isr_entry is not None]
+                if name in names:
+                    del names[len(names) - 1 - names[::-1].index(name):]
+                if name in WRITE_FUNCTIONS:
+                    caller = next((n for n in reversed(names) if n not in WRITE_FUNCTIONS),
+                                  "_main")
+                    writes.setdefault(caller, Stat()).add(spent)
+
+    sim.quit()
+
+    result = {
+        "fosc": fosc,
+        "cycles": int(seconds * fcy),
+        "signal_hz": signal_hz,
+        "functions": {n.lstrip("_"): s.json() for n, s in sorted(functions.items())
+                      if s.values},
+        "isr": isr.json(),
+    }
+
+    # the whole Frequency_report call, its own
+    # formatting and writes and nothing else
+    report = functions.get(REPORT_FUNCTION)
+    if report and report.values:
+        result["report_cycles"] = report.json()["mean"]
+
+    result["usart_writes"] = {n.lstrip("_"): dict(s.json(), cycles=sum(s.values))
+                              for n, s in sorted(writes.items())}
+
+    if len(tx) > 1:
+        result["usart"] = {"bytes": len(tx),
+                           "bytes_per_second": round((len(tx) - 1) * fcy / (tx[-1] - tx[0]), 1)}
+    else:
+        result["usart"] = {"bytes": len(tx), "bytes_per_second": 0}
+
+    return result
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+
+    parser = argparse.ArgumentParser(description="gpsim cycle benchmarks")
+    parser.add_argument("programs", nargs="*",
+                        default=[os.path.join(here, "..", d) for d in ("timer0", "timer1", "blink")])
+    parser.add_argument("--build", action="store_true", help="run build.sh first")
+    parser.add_argument("--seconds", type=float, default=2.0, help="simulated run time")
+    parser.add_argument("--signal-hz", type=float, default=1000.0)
+    parser.add_argument("--out", help="json file, default stdout")
+    args = parser.parse_args()
+
+    results = {}
+    for program in args.programs:
+        name = os.path.basename(os.path.normpath(program))
+        if args.build:
+            subprocess.run(["./build.sh"], cwd=program, check=True,
+                           stdout=subprocess.DEVNULL)
+        print("bench: " + name, file=sys.stderr)
+        results[name] = bench(program, args.seconds, args.signal_hz)
+
+    text = json.dumps(results, indent=2, sort_keys=True)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
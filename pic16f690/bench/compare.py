@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+Compare two bench.py result files
+
+Lists every cycle count that went up by more than
+the tolerance (percent) from the old run to the
+new one, and usart throughput that went down.
+Exit status is 1 if anything got worse, so it can
+gate a firmware change.
+
+usage:
+  compare.py old.json new.json [--tolerance 2]
+"""
+
+import argparse
+import json
+import sys
+
+
+def metrics(result):
+    """flat {name: (value, higher is better)}"""
+    out = {}
+    for name, stat in result.get("functions", {}).items():
+        if stat.get("calls"):
+            out[name + ".mean"] = (stat["mean"], False)
+            out[name + ".max"] = (stat["max"], False)
+    isr = result.get("isr", {})
+    if isr.get("calls"):
+        out["isr.mean"] = (isr["mean"], False)
+        out["isr.max"] = (isr["max"], False)
+    if "report_cycles" in result:
+        out["report_cycles"] = (result["report_cycles"], False)
+    for caller, stat in result.get("usart_writes", {}).items():
+        if stat.get("calls"):
+            out["usart_writes." + caller + ".mean"] = (stat["mean"], False)
+    usart = result.get("usart", {})
+    if usart.get("bytes_per_second"):
+        out["usart.bytes_per_second"] = (usart["bytes_per_second"], True)
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare bench.py results")
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--tolerance", type=float, default=2.0, help="percent")
+    args = parser.parse_args()
+
+    with open(args.old) as f:
+        old = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+
+    worse = 0
+    for program in sorted(set(old) & set(new)):
+        a = metrics(old[program])
+        b = metrics(new[program])
+        for name in sorted(set(a) & set(b)):
+            before, higher = a[name]
+            after = b[name][0]
+            if not before:
+                continue
+            change = (after - before) * 100.0 / before
+            if higher:
+                change = -change
+            mark = ""
+            if change > args.tolerance:
+                mark = "  WORSE"
+                worse += 1
+            elif change < -args.tolerance:
+                mark = "  better"
+            print("%-8s %-36s %12s %12s %+7.1f%%%s" % (program, name, before, after,
+                                                       -change if higher else change, mark))
+
+    print("%d metric(s) worse than %.1f%%" % (worse, args.tolerance))
+    sys.exit(1 if worse else 0)
+
+
+if __name__ == "__main__":
+    main()
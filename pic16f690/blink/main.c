@@ -62,8 +62,43 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 //////////////////////////////////////////////
 
 
+//////////////////////////////////////////////
+//OSCCON is left at reset, 4mhz internal osc.
+//Timer2 runs free with a 1ms period for
+//Delay_ms, at 4mhz 1:4 prescale, 250 ticks, see
+//timer2.h.
+#define SYSTEM_CLOCK        4000000
+
+#include "../common/timer2.h"
+
+
+//////////////////////////////////////////////
+//Low power - sleep between toggles instead of
+//spinning in Delay_ms.  The software wdt (config
+//word has it off) wakes it, 1:1024 of the 31khz
+//lfintosc is 33ms, untrimmed.  Nothing else runs
+//in sleep, timer2 stops with the clock, so it
+//times the awake part of each pass.
+//gPowerAwakeUs / gPowerAsleepMs - time awake and
+//asleep, the latter in whole wdt periods.
+//Off by default, like the other programs.
+//#define USE_SLEEP           1
+#define POWER_WDTPS         0x05        //1:1024
+#define POWER_PERIOD_MS     33
+#define POWER_SLEEP_PERIODS 2           //66ms
+
+#ifdef USE_SLEEP
+unsigned long gPowerAwakeUs = 0;
+unsigned long gPowerAsleepMs = 0;
+#endif
+
+
 //prototypes
-void Delay(unsigned int val);
+void Timer2_init(void);
+void Delay_ms(unsigned int ms);
+#ifdef USE_SLEEP
+void Power_sleep(void);
+#endif
 
 
 //variables
@@ -77,6 +112,8 @@ int main()
     TRISC = 0x00;       //config as output
     ANSEL = 0x00;       //set as digital
 
+    Timer2_init();
+
     while (1)
     {
         if (!(counter%2))
@@ -86,7 +123,11 @@ int main()
         else if (!(counter%5))
             PORTC ^= (1 << 2);
 
-        Delay(5000);
+#ifdef USE_SLEEP
+        Power_sleep();
+#else
+        Delay_ms(75);       //about what Delay(5000) gave
+#endif
         counter++;
     }
 
@@ -96,18 +137,63 @@ int main()
 
 
 ////////////////////////////////////
-//Generic delay function.  Not calibrated
-//this was just to get the quad-core xmas 
-//tree up and running
-//
-void Delay(unsigned int val)
+//Timer2 - free running at a 1ms period,
+//no interrupt, see Delay_ms
+void Timer2_init(void)
+{
+    TMR2ON = 0;
+    PR2 = TIMER2_TICKS_PER_MS - 1;
+    TMR2 = 0x00;
+    T2CON = TIMER2_PRESCALE;        //postscale 1:1
+    TMR2IF = 0;
+    TMR2ON = 1;
+}
+
+
+
+////////////////////////////////////
+//Delay in ms.  Counts timer2 periods,
+//the first one is restarted so it is
+//a full ms.  Replaces the old volatile
+//countdown, which was never calibrated.
+void Delay_ms(unsigned int ms)
 {
-    volatile unsigned int temp = val;
-    while(temp > 0)
-        temp--;
+    TMR2 = 0x00;            //clears the prescaler too
+    TMR2IF = 0;
+
+    while (ms > 0)
+    {
+        if (TMR2IF)
+        {
+            TMR2IF = 0;
+            ms--;
+        }
+    }
 }
 
 
 
+#ifdef USE_SLEEP
+////////////////////////////////////
+//Sleep POWER_SLEEP_PERIODS wdt periods.
+//TMR2 has counted the awake part since
+//the last wake, take it and clear it.
+//The nop after sleep is already fetched
+//on wake up.
+void Power_sleep(void)
+{
+    unsigned char i;
 
+    gPowerAwakeUs += (unsigned long)TMR2 * TIMER2_US_PER_TICK;
+    TMR2 = 0x00;
 
+    WDTCON = (POWER_WDTPS << 1) | 0x01;     //SWDTEN
+    for (i = 0; i < POWER_SLEEP_PERIODS; i++)
+    {
+        __asm sleep __endasm;
+        __asm nop __endasm;
+        gPowerAsleepMs += POWER_PERIOD_MS;
+    }
+    WDTCON = (POWER_WDTPS << 1);
+}
+#endif
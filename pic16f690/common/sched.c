@@ -0,0 +1,335 @@
+/*
+Scheduler, software timers and atomic access,
+see sched.h.  Included at the end of the program
+that uses it, not built on its own.
+*/
+
+
+//////////////////////////////////////////
+//Timer2 - free running at a 1ms period.  TMR2
+//is only ever read, Sched_run times the tasks
+//off it.  Its interrupt is the 1ms tick of the
+//scheduler and the software timers.
+void Timer2_init(void)
+{
+    TMR2ON = 0;
+    PR2 = TIMER2_TICKS_PER_MS - 1;
+    TMR2 = 0x00;
+    T2CON = TIMER2_PRESCALE;        //postscale 1:1
+    TMR2IF = 0;
+    TMR2IE = 1;
+    PEIE = 1;
+    TMR2ON = 1;
+}
+
+
+//////////////////////////////////////////
+//Start every task a full period from now
+void Sched_init(void)
+{
+    unsigned char i;
+
+    for (i = 0 ; i < TASK_COUNT ; i++)
+    {
+        gTaskState[i].period = gTaskTable[i].period;
+        gTaskState[i].due = gTaskTable[i].period;
+        gTaskState[i].ready = 0x00;
+#ifdef USE_SCHED_STATS
+        gTaskState[i].wait = 0x00;
+        gTaskState[i].runs = 0x00;
+        gTaskState[i].late = 0x00;
+        gTaskState[i].worst = 0x00;
+#endif
+    }
+
+    gSchedPending = 0x00;
+}
+
+
+//////////////////////////////////////////
+//Take the ticks the isr counted, then run each
+//task that is due once.  gSchedPending-- is a
+//single decf, the isr can't split it.  The run
+//time is the ticks the isr counted meanwhile
+//plus the TMR2 difference.
+void Sched_run(void)
+{
+    unsigned char i;
+#ifdef USE_SCHED_STATS
+    unsigned char pending, start, now;
+    unsigned int ticks;
+#endif
+
+    while (gSchedPending)
+    {
+        gSchedPending--;
+
+        for (i = 0 ; i < TASK_COUNT ; i++)
+        {
+#ifdef USE_SCHED_STATS
+            if (gTaskState[i].ready)
+                gTaskState[i].wait++;
+#endif
+
+            if (!--gTaskState[i].due)
+            {
+                gTaskState[i].due = gTaskState[i].period;
+#ifdef USE_SCHED_STATS
+                if (gTaskState[i].ready)
+                    gTaskState[i].late++;       //overrun, one release lost
+                gTaskState[i].wait = 0x00;
+#endif
+                gTaskState[i].ready = 1;
+            }
+        }
+    }
+
+    for (i = 0 ; i < TASK_COUNT ; i++)
+    {
+        if (!gTaskState[i].ready)
+            continue;
+
+        gTaskState[i].ready = 0x00;
+#ifndef USE_SCHED_STATS
+        gTaskTable[i].run();
+#else
+        if (gTaskState[i].wait > gTaskTable[i].deadline)
+            gTaskState[i].late++;
+
+        pending = gSchedPending;
+        start = TMR2;
+        gTaskTable[i].run();
+        now = TMR2;
+        pending = gSchedPending - pending;
+        if ((now < start) && !pending)
+            pending = 1;                //wrapped, the isr has not counted it yet
+        ticks = (unsigned int)pending * TIMER2_TICKS_PER_MS + now - start;
+
+        gTaskState[i].runs++;
+        if (ticks > gTaskState[i].worst)
+            gTaskState[i].worst = ticks;
+#endif
+    }
+}
+
+
+//////////////////////////////////////////
+//Change a task period, main loop.  The next
+//release is no further out than the new period.
+void Sched_setPeriod(unsigned char task, unsigned int period)
+{
+    gTaskState[task].period = period;
+    if (gTaskState[task].due > period)
+        gTaskState[task].due = period;
+}
+
+
+//////////////////////////////////////////
+//Software timers, see TIMER_COUNT
+
+//all stopped, nothing fired
+void Timer_init(void)
+{
+    unsigned char i;
+
+    for (i = 0 ; i < TIMER_COUNT ; i++)
+    {
+        gTimers[i].delta = 0x00;
+        gTimers[i].period = 0x00;
+        gTimers[i].next = TIMER_NONE;
+        gTimers[i].running = 0x00;
+        gTimers[i].fired = 0x00;
+    }
+    gTimerHead = TIMER_NONE;
+}
+
+
+//(Re)start a timer, fires ms from now, then
+//every period ms if period is not 0.  Clears
+//a fired flag still set from before.
+void Timer_start(unsigned char id, unsigned int ms, unsigned int period)
+{
+    unsigned char gie = Atomic_begin();
+
+    Timer_unlink(id);
+    gTimers[id].period = period;
+    gTimers[id].fired = 0x00;
+    Timer_insert(id, ms ? ms : 1);
+
+    Atomic_end(gie);
+}
+
+
+void Timer_stop(unsigned char id)
+{
+    unsigned char gie = Atomic_begin();
+
+    Timer_unlink(id);
+    gTimers[id].fired = 0x00;
+
+    Atomic_end(gie);
+}
+
+
+//1 once for each time the timer fired, polled
+//timers only
+unsigned char Timer_expired(unsigned char id)
+{
+    unsigned char fired;
+    unsigned char gie = Atomic_begin();
+
+    fired = gTimers[id].fired;
+    gTimers[id].fired = 0x00;
+
+    Atomic_end(gie);
+    return fired;
+}
+
+
+//Callbacks of the timers that fired, main loop
+void Timer_service(void)
+{
+    unsigned char i;
+
+    for (i = 0 ; i < TIMER_COUNT ; i++)
+    {
+        if (gTimerCallback[i] && Timer_expired(i))
+            gTimerCallback[i]();
+    }
+}
+
+
+//1ms tick, isr only.  Counts down the head,
+//everything behind it moves with it.
+void Timer_tick(void)
+{
+    unsigned char id;
+
+    if (gTimerHead == TIMER_NONE)
+        return;
+
+    gTimers[gTimerHead].delta--;
+    while ((gTimerHead != TIMER_NONE) && !gTimers[gTimerHead].delta)
+    {
+        id = gTimerHead;
+        gTimerHead = gTimers[id].next;
+        gTimers[id].running = 0x00;
+        gTimers[id].fired = 1;
+
+        if (gTimers[id].period)
+            Timer_insert(id, gTimers[id].period);
+    }
+}
+
+
+//Into the delta list ms from now, ms > 0.  Isr,
+//or main with interrupts off.  Walks past the
+//timers that fire first (ties go after, so they
+//fire in start order) taking their deltas off.
+void Timer_insert(unsigned char id, unsigned int ms)
+{
+    unsigned char prev = TIMER_NONE;
+    unsigned char i = gTimerHead;
+
+    while ((i != TIMER_NONE) && (gTimers[i].delta <= ms))
+    {
+        ms -= gTimers[i].delta;
+        prev = i;
+        i = gTimers[i].next;
+    }
+
+    gTimers[id].delta = ms;
+    gTimers[id].next = i;
+    if (i != TIMER_NONE)
+        gTimers[i].delta -= ms;
+
+    if (prev == TIMER_NONE)
+        gTimerHead = id;
+    else
+        gTimers[prev].next = id;
+    gTimers[id].running = 1;
+}
+
+
+//Out of the delta list, its time left goes to
+//the one behind.  Main with interrupts off.
+void Timer_unlink(unsigned char id)
+{
+    unsigned char prev = TIMER_NONE;
+    unsigned char i = gTimerHead;
+    unsigned char next;
+
+    if (!gTimers[id].running)
+        return;
+
+    while (i != id)
+    {
+        prev = i;
+        i = gTimers[i].next;
+    }
+
+    next = gTimers[id].next;
+    if (next != TIMER_NONE)
+        gTimers[next].delta += gTimers[id].delta;
+
+    if (prev == TIMER_NONE)
+        gTimerHead = next;
+    else
+        gTimers[prev].next = next;
+    gTimers[id].running = 0x00;
+}
+
+
+//////////////////////////////////
+//Interrupts off, returns the GIE to give to
+//Atomic_end.  An interrupt taken right as GIE
+//clears sets it again on retfie, so check it
+//stuck.
+unsigned char Atomic_begin(void)
+{
+    unsigned char gie = GIE;
+
+    do
+    {
+        GIE = 0;
+    } while (GIE);
+
+    return gie;
+}
+
+
+//////////////////////////////////
+//Interrupts back as they were at Atomic_begin
+void Atomic_end(unsigned char gie)
+{
+    if (gie)
+        GIE = 1;
+}
+
+
+//////////////////////////////////
+//Consistent copy of an isr written int
+unsigned int Atomic_readInt(volatile unsigned int* value)
+{
+    unsigned int copy;
+    unsigned char gie = Atomic_begin();
+
+    copy = *value;
+    Atomic_end(gie);
+
+    return copy;
+}
+
+
+//////////////////////////////////
+//Consistent copy of an isr written long
+unsigned long Atomic_readLong(volatile unsigned long* value)
+{
+    unsigned long copy;
+    unsigned char gie = Atomic_begin();
+
+    copy = *value;
+    Atomic_end(gie);
+
+    return copy;
+}
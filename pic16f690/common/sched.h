@@ -0,0 +1,142 @@
+/*
+Scheduler, software timers and atomic access
+for the timer1 programs, main.c and main_withrx.c
+
+Not built on its own.  SDCC builds one file per
+program (build.sh), and the task and timer
+tables are the program's, so each program
+includes this where its settings are and
+sched.c at the end:
+
+#define SYSTEM_CLOCK, TASK_COUNT, TIMER_COUNT
+(and USE_SCHED_STATS for the task accounting)
+#include "../common/sched.h"
+gTaskTable[TASK_COUNT], gTimerCallback[TIMER_COUNT]
+...
+#include "../common/sched.c"
+
+Timer2 is the 1ms tick, the program's isr calls
+Timer_tick and counts gSchedPending on TMR2IF.
+*/
+#ifndef __SCHED_H
+#define __SCHED_H
+
+////////////////////////////////////////////////
+//Timer2 runs free with a 1ms period, the
+//scheduler and software timer tick, see timer2.h
+#include "timer2.h"
+
+void Timer2_init(void);
+
+////////////////////////////////////
+//task scheduler - main loop work when awake
+//Timer2 interrupts every 1ms and the isr only
+//counts the tick into gSchedPending.  Sched_run
+//takes the ticks, counts each task down and runs
+//the ones that came due, in table order, each to
+//completion.  Nothing due - it returns at once
+//and the rest of the pass is free.
+//
+//period - ms between releases.  The next release
+//counts from the last one, not from when the
+//task got to run, so a late run does not push
+//the ones after it and every rate is exact.
+//deadline - ms after its release a task has to
+//start by.  Later, or released again before it
+//ran, counts in late.
+//runs / late / worst - accounting, worst is the
+//longest run in timer2 ticks (8us at 8mhz).  Only
+//with USE_SCHED_STATS, 8 bytes of ram a task.
+typedef struct
+{
+    void (*run)(void);
+    unsigned int period;        //ms
+    unsigned int deadline;      //ms after release
+} Task;
+
+typedef struct
+{
+    unsigned int period;        //ms, from gTaskTable, Sched_setPeriod
+    unsigned int due;           //ms to the next release
+    unsigned char ready;        //released, not run yet
+#ifdef USE_SCHED_STATS
+    unsigned int wait;          //ms since the release
+    unsigned int runs;
+    unsigned int late;
+    unsigned int worst;         //timer2 ticks
+#endif
+} TaskState;
+
+TaskState gTaskState[TASK_COUNT];
+volatile unsigned char gSchedPending = 0x00;    //isr - ticks not taken yet
+
+void Sched_init(void);
+void Sched_run(void);
+void Sched_setPeriod(unsigned char task, unsigned int period);
+
+////////////////////////////////////
+//software timers - one time base for timeouts
+//TIMER_COUNT timers off the same 1ms timer2
+//interrupt.  The running ones are kept in a
+//delta list in order of expiry, each holds the
+//ms after the one in front of it, so a tick
+//only counts down the head - O(1) however many
+//are running.  An expired timer sets its fired
+//flag and leaves the list, a periodic one goes
+//back in a period later (a walk of the list, in
+//the isr).
+//
+//Timer_start / Timer_stop are main loop only,
+//they change the list with interrupts off.  Poll
+//a timer with Timer_expired, or give it a
+//callback in gTimerCallback - Timer_service runs
+//those from the main loop, never in the isr.
+#define TIMER_NONE          0xFF    //end of the list
+
+typedef struct
+{
+    unsigned int delta;         //ms after the timer in front
+    unsigned int period;        //ms, 0 - one shot
+    unsigned char next;         //list link
+    unsigned char running;      //in the list
+    unsigned char fired;        //isr sets, main clears
+} SoftTimer;
+
+typedef void (*TimerCallback)(void);
+
+SoftTimer gTimers[TIMER_COUNT];
+volatile unsigned char gTimerHead = TIMER_NONE;
+
+void Timer_init(void);
+void Timer_start(unsigned char id, unsigned int ms, unsigned int period);
+void Timer_stop(unsigned char id);
+unsigned char Timer_expired(unsigned char id);
+void Timer_service(void);
+void Timer_tick(void);
+void Timer_insert(unsigned char id, unsigned int ms);
+void Timer_unlink(unsigned char id);
+
+////////////////////////////////////
+//atomic access to isr shared state
+//The core moves a byte at a time, so a 16 or 32
+//bit value the isr writes can be read half old,
+//half new.  Main loop reads of anything the isr
+//writes (and writes of anything it reads) wider
+//than a byte go through these.  Single bytes,
+//and the queue heads / tails, don't need it.
+//
+//Atomic_begin clears GIE and returns what it
+//was, Atomic_end puts it back, so sections nest
+//and work with interrupts already off.  The copy
+//functions hold GIE off for the copy only, a few
+//tens of cycles through the generic pointer, an
+//interrupt that comes up meanwhile is taken late,
+//not lost.  Main loop only, SDCC functions are
+//not reentrant and the isr would overwrite the
+//saved GIE.
+unsigned char Atomic_begin(void);
+void Atomic_end(unsigned char gie);
+unsigned int Atomic_readInt(volatile unsigned int* value);
+unsigned long Atomic_readLong(volatile unsigned long* value);
+
+#endif
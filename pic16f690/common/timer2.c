@@ -0,0 +1,29 @@
+/*
+Delay_us, see timer2.h.  Included at the end of
+the program that uses it, not built on its own.
+*/
+
+
+//////////////////////////////////////////
+//Delay in us on timer2, to within one tick
+//(8us at 8mhz) plus the call.  Only reads TMR2,
+//so it works with the timer2 interrupt on and
+//leaves the other timer2 users alone.  Anything
+//shorter, use HAL_DELAY_US with a constant.
+void Delay_us(unsigned int us)
+{
+    unsigned int ticks = us / TIMER2_US_PER_TICK;
+    unsigned char last, now, t;
+
+    last = TMR2;
+    while (ticks > 0)
+    {
+        HAL_POLL(30);
+        now = TMR2;
+        t = now - last;
+        if (now < last)
+            t += TIMER2_TICKS_PER_MS;       //PR2 match in between
+        last = now;
+        ticks = (t < ticks) ? (ticks - t) : 0;
+    }
+}
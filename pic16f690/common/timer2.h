@@ -0,0 +1,42 @@
+/*
+Timer2 settings from SYSTEM_CLOCK, and Delay_us
+
+Shared by every program, so the prescale and
+period can't drift between them.  Define
+SYSTEM_CLOCK before including this.  Delay_us is
+in timer2.c, included at the end of the program
+that wants it, not built on its own.
+*/
+#ifndef __TIMER2_H
+#define __TIMER2_H
+
+#ifndef SYSTEM_CLOCK
+#error "define SYSTEM_CLOCK before timer2.h"
+#endif
+
+////////////////////////////////////////////////
+//Timer2 runs free with a 1ms period (PR2 match).
+//The prescale is the smallest that fits 1ms in 8
+//bits, at 8mhz that is 1:16, 125 ticks of 8us.
+#define CYCLES_PER_MS       (SYSTEM_CLOCK / 4000)
+
+#if (CYCLES_PER_MS <= 256)
+#define TIMER2_PRESCALE     0x00                //1:1
+#define TIMER2_TICKS_PER_MS (CYCLES_PER_MS)
+#elif (CYCLES_PER_MS <= 1024)
+#define TIMER2_PRESCALE     0x01                //1:4
+#define TIMER2_TICKS_PER_MS (CYCLES_PER_MS / 4)
+#else
+#define TIMER2_PRESCALE     0x02                //1:16
+#define TIMER2_TICKS_PER_MS (CYCLES_PER_MS / 16)
+#endif
+
+#if (TIMER2_TICKS_PER_MS > 256) || (1000 % TIMER2_TICKS_PER_MS)
+#error "SYSTEM_CLOCK gives no whole 1ms timer2 period"
+#endif
+
+#define TIMER2_US_PER_TICK  (1000 / TIMER2_TICKS_PER_MS)
+
+void Delay_us(unsigned int us);
+
+#endif
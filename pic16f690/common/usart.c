@@ -0,0 +1,457 @@
+/*
+Usart rings, command interpreter and the number
+formatting, see usart.h.  Included at the end of
+the program that uses it, not built on its own.
+*/
+
+
+//////////////////////////////////////////
+//RCIF, isr only.  One byte into the line being
+//filled, see rxLine.
+void USART_rxIsr(void)
+{
+    unsigned char c;
+
+    c = RCREG;      //clears RCIF
+
+    //start of a line, both buffers still
+    //waiting on the main loop - drop the line
+    if ((rxIndex == 0x00) && (rxLength[rxActive] != 0x00))
+    {
+        gRxOverrun++;
+        rxIndex = RX_LINE_DISCARD;
+    }
+
+    if (rxIndex == RX_LINE_DISCARD)
+    {
+        if (c == '\n')
+            rxIndex = 0x00;
+    }
+    else if (c != 0x00)
+    {
+        if (rxIndex < (RX_BUFFER_SIZE - 1))
+        {
+            rxLine[rxActive][rxIndex] = c;
+            rxIndex++;
+        }
+
+        //end of message - post it, switch buffers
+        if (c == '\n')
+        {
+            rxLine[rxActive][rxIndex] = 0x00;
+            rxLength[rxActive] = rxIndex;
+            rxActive ^= 0x01;
+            rxIndex = 0x00;
+        }
+    }
+
+    //overrun stops the receiver, restart it
+    if (OERR == 1)
+    {
+        CREN = 0;
+        HAL_SYNC();
+        CREN = 1;
+    }
+}
+
+
+//////////////////////////////////////////
+//TXIF, isr only.  TXIF stays set as long as
+//TXREG is empty, so only call it while TXIE is
+//enabled.  Writing TXREG clears TXIF.
+void USART_txIsr(void)
+{
+    TXREG = txBuffer[txTail];
+    txTail = (txTail + 1) & TX_BUFFER_MASK;
+
+    //ring is empty, stop until next write
+    if (txTail == txHead)
+        TXIE = 0;
+}
+
+
+////////////////////////////////////////////////
+//Auto-baud, see gAutoBaud.  The other end sends
+//a 'U' (0x55), the generator times its 5 rising
+//edges and loads SPBRGH:SPBRG itself, in the
+//BRG16 / BRGH mode set by USART_init.
+//
+//Start - returns 0 if one is already running.
+//timeout ms covers the drain and the wait.
+unsigned char USART_autoBaudStart(unsigned int timeout)
+{
+    if (gAutoBaud.state != AUTOBAUD_IDLE)
+        return 0;
+
+    gAutoBaud.brgh = SPBRGH;
+    gAutoBaud.brg = SPBRG;
+    gAutoBaud.rx = RCIE | (CREN << 1);
+
+    RCIE = 0;
+    CREN = 1;
+    Timer_start(TIMER_SERIAL, timeout, 0);
+    gAutoBaud.state = AUTOBAUD_DRAIN;
+
+    return 1;
+}
+
+
+//Poll, main loop.  AUTOBAUD_OK or AUTOBAUD_FAIL
+//once when it ends, on a time out or ABDOVF (too
+//slow for the 16 bit count) the old divisor is
+//put back.  The 'U' leaves a junk byte in RCREG,
+//it is read off here with the rx isr still off.
+unsigned char USART_autoBaudPoll(void)
+{
+    unsigned char expired;
+    unsigned char result = AUTOBAUD_OK;
+
+    if (gAutoBaud.state == AUTOBAUD_IDLE)
+        return AUTOBAUD_IDLE;
+
+    expired = Timer_expired(TIMER_SERIAL);
+    if (gAutoBaud.state == AUTOBAUD_DRAIN)
+    {
+        if (!expired)
+        {
+            if (TXIE || !TRMT || !RCIDL)
+                return AUTOBAUD_BUSY;
+
+            ABDOVF = 0;
+            ABDEN = 1;
+            gAutoBaud.state = AUTOBAUD_ARMED;
+            return AUTOBAUD_BUSY;
+        }
+    }
+    else if (ABDEN && !ABDOVF && !expired)
+        return AUTOBAUD_BUSY;
+    Timer_stop(TIMER_SERIAL);
+
+    if ((gAutoBaud.state == AUTOBAUD_DRAIN) || ABDEN || ABDOVF)
+    {
+        ABDEN = 0;
+        ABDOVF = 0;
+        SPBRGH = gAutoBaud.brgh;
+        SPBRG = gAutoBaud.brg;
+        result = AUTOBAUD_FAIL;
+    }
+
+    //junk byte, and any that came in meanwhile
+    while (RCIF)
+        (void)RCREG;
+    if (OERR)
+    {
+        CREN = 0;
+        HAL_SYNC();
+    }
+
+    CREN = gAutoBaud.rx >> 1;
+    RCIE = gAutoBaud.rx & 0x01;
+    gAutoBaud.state = AUTOBAUD_IDLE;
+
+    //what was written while ARMED
+    if (txTail != txHead)
+        TXIE = 1;
+
+    return result;
+}
+
+
+//////////////////////////////////////////////
+//Serial Write
+//buffer and  a length
+//
+//Non-blocking - copies into the tx ring and
+//returns the number of bytes queued.  If the
+//ring fills, the rest of the buffer is dropped.
+//
+unsigned char USART_Write(char* buffer, unsigned char length)
+{
+    unsigned char i = 0;
+    unsigned char next;
+
+    for (i = 0 ; i < length ; i++)
+    {
+        next = (txHead + 1) & TX_BUFFER_MASK;
+        if (next == txTail)
+        {
+            gTxDropped += (length - i);
+            break;
+        }
+
+        txBuffer[txHead] = buffer[i];
+        txHead = next;
+    }
+
+    //isr takes it from here, not while auto-baud
+    //is timing the 'U'
+    if ((i > 0) && (gAutoBaud.state != AUTOBAUD_ARMED))
+        TXIE = 1;
+
+    return i;
+}
+
+
+///////////////////////////////////////////////
+//Write null terminated string, max 64 chars.
+//Same overflow policy as USART_Write.
+unsigned char USART_WriteString(const char* buffer)
+{
+    unsigned char i = 0;
+    unsigned char num = 0;
+    unsigned char next;
+
+    while ((buffer[i] != 0x00) && (i < 64))
+    {
+        next = (txHead + 1) & TX_BUFFER_MASK;
+        if ((next == txTail) || (num != i))
+            gTxDropped++;       //full, drop the rest
+        else
+        {
+            txBuffer[txHead] = buffer[i];
+            txHead = next;
+            num++;
+        }
+        i++;
+    }
+
+    if ((num > 0) && (gAutoBaud.state != AUTOBAUD_ARMED))
+        TXIE = 1;
+
+    return num;
+}
+
+
+///////////////////////////////////////////////
+//Number of bytes that can be queued without
+//dropping any.
+unsigned char USART_TxFree(void)
+{
+    return (txTail - txHead - 1) & TX_BUFFER_MASK;
+}
+
+
+///////////////////////////////////////////////
+//Wait for room for room bytes, main loop.  For
+//command replies, readings don't wait.  Not
+//while auto-baud holds the ring, see gAutoBaud.
+void USART_TxWait(unsigned char room)
+{
+    while ((USART_TxFree() < room) && (gAutoBaud.state != AUTOBAUD_ARMED)){HAL_POLL(10);};
+}
+
+
+///////////////////////////////////////
+//Parse completed lines from the rx line
+//queue, oldest first.  Runs in the main loop
+//so commands are free to write to the usart.
+//The line is parsed in place and the buffer
+//handed back to the isr when done.
+void USART_ServiceRx(void)
+{
+    while (rxLength[rxRead] != 0x00)
+    {
+        USART_ProcessCommand(rxLine[rxRead], rxLength[rxRead]);
+        rxLength[rxRead] = 0x00;
+        rxRead ^= 0x01;
+    }
+}
+
+
+///////////////////////////////////////
+//One command line, see gCommandTable.  The
+//keyword ends at a space or the line end.
+void USART_ProcessCommand(unsigned char* buffer, unsigned char length)
+{
+    unsigned char i = 0;
+    unsigned char slot, name, arg;
+    unsigned char ok = 0;
+    const char* match;
+
+    while ((i < length) && (buffer[i] > ' '))
+        i++;
+    if (!i)
+        return;                     //blank line
+
+    slot = gCommandSlot[Command_hash(buffer, i)];
+    if (slot != CMD_NONE)
+    {
+        //the one candidate, whole word
+        match = gCommandTable[slot].name;
+        for (name = 0 ; (name < i) && (match[name] == buffer[name]) ; name++)
+            ;
+
+        arg = Command_arg(buffer + i);
+        gCommandHasArg = (arg == CMD_ARG_VALUE);
+
+        if ((name == i) && (match[name] == 0x00) && (gCommandTable[slot].args & arg))
+            ok = gCommandTable[slot].run();
+    }
+
+    USART_TxWait(4);
+    if (ok)
+        USART_WriteString("ok\r\n");
+    else
+        USART_WriteString("?\r\n");
+}
+
+
+///////////////////////////////////////
+//first + second + 2 * last char + length, the
+//second is 0 for a one letter word
+unsigned char Command_hash(unsigned char* word, unsigned char length)
+{
+    unsigned char hash = word[0] + (word[length - 1] << 1) + length;
+
+    if (length > 1)
+        hash += word[1];
+
+    return hash & CMD_HASH_MASK;
+}
+
+
+///////////////////////////////////////
+//The text after the keyword - CMD_ARG_NONE,
+//CMD_ARG_VALUE with the number in gCommandArg,
+//or CMD_ARG_BAD for anything else or over 16
+//bits.  value * 10 = value * 8 + value * 2.
+unsigned char Command_arg(unsigned char* text)
+{
+    unsigned int value = 0;
+    unsigned char digit;
+    unsigned char digits = 0;
+
+    while (*text == ' ')
+        text++;
+
+    while ((*text >= '0') && (*text <= '9'))
+    {
+        digit = *text - '0';
+        if ((value > 6553) || ((value == 6553) && (digit > 5)))
+            return CMD_ARG_BAD;
+
+        value = (value << 3) + (value << 1) + digit;
+        digits++;
+        text++;
+    }
+
+    while ((*text == ' ') || (*text == '\r') || (*text == '\n'))
+        text++;
+    if (*text != 0x00)
+        return CMD_ARG_BAD;
+
+    if (!digits)
+        return CMD_ARG_NONE;
+
+    gCommandArg = value;
+    return CMD_ARG_VALUE;
+}
+
+
+///////////////////////////////////////
+//" label 1234", waits for room first
+void Command_value(const char* label, unsigned long value)
+{
+    USART_TxWait(20);
+    USART_WriteString(label);
+    n = dec2Buff(value, outbuffer);
+    USART_Write(outbuffer, n);
+}
+
+
+//////////////////////////////////
+//crc-8, poly 0x07, a nibble at a time off
+//gCrc8Table
+unsigned char Crc8_update(unsigned char crc, unsigned char data)
+{
+    crc ^= data;
+    crc = (crc << 4) ^ gCrc8Table[crc >> 4];
+    crc = (crc << 4) ^ gCrc8Table[crc >> 4];
+    return crc;
+}
+
+
+///////////////////////////////////////////
+//convert unsigned long value into a char
+//buffer with return value of num chars to 
+//print.  Handles the full 32 bit range,
+//upto 4294967295 - 10 chars + null.
+//
+//Division free - each digit is found by
+//subtracting the power of ten until it no
+//longer fits (max 9 subtractions per digit),
+//digits are written in order straight into
+//buffer so no reverse or scratch copy is
+//needed.  Once the value is below 10000 the
+//rest runs with 16 bit math.
+//
+//The old version called the sdcc long
+//divide and modulus helpers for every digit.
+//No cycle counts have been measured for
+//either version yet - the only figures are
+//estimates read off the library code (about
+//1000 cycles per helper call, so 20k+ for a
+//10 digit value, vs a few thousand for this
+//one).  Build timer1/main.c with DEC2BUFF_BENCH
+//defined and run it on the target (or gpsim)
+//to get real numbers.
+//
+__code const unsigned long gPow10Long[6] = {
+    1000000000, 100000000, 10000000, 1000000, 100000, 10000
+};
+
+__code const unsigned int gPow10Int[4] = {
+    1000, 100, 10, 1
+};
+
+unsigned char dec2Buff(unsigned long val, char* buffer)
+{
+    unsigned char i = 0;
+    unsigned char num = 0;
+    char digit;
+    unsigned long p;
+    unsigned int val16, p16;
+
+    //upper digits - 32 bit
+    for (i = 0 ; i < 6 ; i++)
+    {
+        p = gPow10Long[i];
+        digit = '0';
+        while (val >= p)
+        {
+            val -= p;
+            digit++;
+        }
+
+        //skip leading zeros
+        if ((num > 0) || (digit != '0'))
+        {
+            buffer[num] = digit;
+            num++;
+        }
+    }
+
+    //lower 4 digits - fits in 16 bits now
+    val16 = (unsigned int)val;
+    for (i = 0 ; i < 4 ; i++)
+    {
+        p16 = gPow10Int[i];
+        digit = '0';
+        while (val16 >= p16)
+        {
+            val16 -= p16;
+            digit++;
+        }
+
+        //always keep the ones digit, 0 -> "0"
+        if ((num > 0) || (digit != '0') || (i == 3))
+        {
+            buffer[num] = digit;
+            num++;
+        }
+    }
+
+    buffer[num] = 0x00;     //null terminated
+    
+    return num;
+}
@@ -0,0 +1,195 @@
+/*
+Usart transmit ring, receive line queue and
+command interpreter for the timer1 programs,
+main.c and main_withrx.c
+
+Not built on its own, same as sched.h.  The
+program defines BAUD_RATE (and any of the sizes
+below it wants different) before including this,
+gCommandTable / gCommandSlot after, its own
+USART_init, and includes usart.c at the end.
+The isr calls USART_rxIsr on RCIF and
+USART_txIsr on TXIF.  Needs sched.h, auto-baud
+times out on TIMER_SERIAL and the main loop
+calls USART_autoBaudPoll.
+*/
+#ifndef __USART_H
+#define __USART_H
+
+////////////////////////////////////////////////
+//usart baud rate, from SYSTEM_CLOCK
+//BRG16 = 1 and BRGH = 1, the generator divides
+//fosc/4 by SPBRGH:SPBRG + 1, table 12-3.  The
+//divisor is rounded and the rate it gives is
+//checked against BAUD_ERROR_MAX (per mille) at
+//compile time.  At 8mhz:
+//
+//  9600    SPBRG 207   +0.2%
+//  19200   SPBRG 103   +0.2%
+//  38400   SPBRG 51    +0.2%
+//  57600   SPBRG 34    -0.8%
+//  115200  SPBRG 16    +2.1% - too far, needs a
+//                      faster clock (or a crystal)
+#ifndef BAUD_ERROR_MAX
+#define BAUD_ERROR_MAX      20                  //per mille
+#endif
+
+#define BAUD_DIVISOR        ((SYSTEM_CLOCK / 4 + BAUD_RATE / 2) / BAUD_RATE)
+#define BAUD_SPBRG          (BAUD_DIVISOR - 1)
+#define BAUD_ACTUAL         (SYSTEM_CLOCK / 4 / BAUD_DIVISOR)
+
+#if (BAUD_DIVISOR < 1) || (BAUD_SPBRG > 0xFFFF)
+#error "BAUD_RATE out of range for SYSTEM_CLOCK"
+#elif ((BAUD_ACTUAL - BAUD_RATE) * 1000 / BAUD_RATE > BAUD_ERROR_MAX) || \
+      ((BAUD_RATE - BAUD_ACTUAL) * 1000 / BAUD_RATE > BAUD_ERROR_MAX)
+#error "BAUD_RATE error over BAUD_ERROR_MAX at SYSTEM_CLOCK"
+#endif
+
+////////////////////////////////////
+//usart output, scratch for formatting
+#ifndef OUT_BUFFER_SIZE
+#define OUT_BUFFER_SIZE     32
+#endif
+unsigned char n;
+char outbuffer[OUT_BUFFER_SIZE];
+
+////////////////////////////////////
+//usart transmit ring buffer
+//USART_Write and USART_WriteString copy into
+//the ring and return right away, the TXIF
+//interrupt moves one byte per interrupt into
+//TXREG.  Size must be a power of 2, holds
+//TX_BUFFER_SIZE - 1 bytes.
+//
+//Overflow policy: bytes that do not fit are
+//dropped (message is truncated) and counted
+//in gTxDropped.  The write functions return
+//the number of bytes actually queued, use
+//USART_TxFree to check for room first.
+#ifndef TX_BUFFER_SIZE
+#define TX_BUFFER_SIZE      32
+#endif
+#define TX_BUFFER_MASK      (TX_BUFFER_SIZE - 1)
+volatile unsigned char txBuffer[TX_BUFFER_SIZE];
+volatile unsigned char txHead = 0x00;       //next write - main
+volatile unsigned char txTail = 0x00;       //next read - isr
+unsigned int gTxDropped = 0x00;             //bytes lost, ring full
+
+////////////////////////////////////
+//receiver - double buffered line queue
+//The isr only stores bytes into rxLine[rxActive].
+//On '\n' the line is terminated, its length is
+//posted in rxLength and the isr moves on to the
+//other buffer.  The main loop parses the posted
+//line in place (USART_ServiceRx) and frees it by
+//clearing rxLength.
+//
+//If both buffers are still waiting when a new
+//line starts, that line is discarded and counted
+//in gRxOverrun.  Lines longer than the buffer are
+//truncated.
+#ifndef RX_BUFFER_SIZE
+#define RX_BUFFER_SIZE      16
+#endif
+#define RX_LINE_DISCARD     0xFF        //rxIndex - skip to '\n'
+unsigned char rxLine[2][RX_BUFFER_SIZE];
+volatile unsigned char rxLength[2] = {0x00, 0x00};  //0 = free
+unsigned char rxActive = 0x00;          //isr - buffer being filled
+unsigned char rxIndex = 0x00;           //isr - next char position
+unsigned char rxRead = 0x00;            //main - next buffer to parse
+volatile unsigned int gRxOverrun = 0x00;
+
+////////////////////////////////////
+//auto-baud, section 12.3.1 - polled, never waits
+//USART_autoBaudStart saves the divisor, stops the
+//receiver isr and starts TIMER_SERIAL, then
+//returns.  USART_autoBaudPoll, once a main loop
+//pass, moves it on - DRAIN until the queued text
+//is out at the old rate and the line is idle,
+//ARMED (ABDEN set) until the 'U' is timed, the
+//count overflows or the timer runs out.  Tasks
+//and timers keep running the whole time.
+//
+//While ARMED the tx ring is held, writes queue
+//and go out after.  USART_TxWait does not wait
+//then, so what doesn't fit is dropped.
+#define AUTOBAUD_IDLE       0x00    //state, and poll - not running
+#define AUTOBAUD_DRAIN      0x01    //state
+#define AUTOBAUD_ARMED      0x02    //state
+#define AUTOBAUD_BUSY       0x01    //poll - still going
+#define AUTOBAUD_OK         0x03    //poll, once - new rate in place
+#define AUTOBAUD_FAIL       0x04    //poll, once - old rate put back
+
+typedef struct
+{
+    unsigned char state;        //AUTOBAUD_IDLE, DRAIN, ARMED
+    unsigned char brgh;         //divisor to put back
+    unsigned char brg;
+    unsigned char rx;           //RCIE, CREN << 1 to put back
+} AutoBaud;
+
+AutoBaud gAutoBaud = {AUTOBAUD_IDLE, 0x00, 0x00, 0x00};
+
+////////////////////////////////////
+//command interpreter
+//A line is a keyword and an optional decimal
+//argument, "rate 500\n".  The keyword is hashed
+//(Command_hash, first, second and last char and
+//the length) into gCommandSlot, which holds the
+//gCommandTable index or CMD_NONE, and compared
+//once against that entry's name.  So a command
+//costs the same however many there are - one
+//hash, one compare, no search.
+//
+//Adding a command - put it in gCommandTable,
+//work out Command_hash of the name and put its
+//index in that slot.  The slot has to be free,
+//else pick another name.
+//
+//The argument is read 16 bit, x10 as shifts
+//and adds, no division.  Every line is answered
+//with "ok" or "?" (unknown keyword, argument
+//missing, not wanted, out of range or more
+//than 65535) after any output of its own, so a
+//host script can send the next one right away.
+#define CMD_HASH_MASK       0x1F
+#define CMD_NONE            0xFF
+
+#define CMD_ARG_NONE        0x01    //Command.args, allowed bits
+#define CMD_ARG_VALUE       0x02
+#define CMD_ARG_BAD         0x04    //never allowed
+
+typedef struct
+{
+    const char* name;
+    unsigned char (*run)(void);     //1 ok, 0 ?
+    unsigned char args;             //CMD_ARG_xxx allowed
+} Command;
+
+unsigned int gCommandArg;           //the argument
+unsigned char gCommandHasArg;       //0 - none given
+
+//crc-8 poly 0x07 of a nibble in the top 4 bits
+__code const unsigned char gCrc8Table[16] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+void USART_init(void);
+unsigned char USART_autoBaudStart(unsigned int timeout);
+unsigned char USART_autoBaudPoll(void);
+unsigned char USART_Write(char* buffer, unsigned char length);
+unsigned char USART_WriteString(const char* buffer);
+unsigned char USART_TxFree(void);
+void USART_TxWait(unsigned char room);
+void USART_ServiceRx(void);
+void USART_ProcessCommand(unsigned char* buffer, unsigned char length);
+void USART_rxIsr(void);
+void USART_txIsr(void);
+unsigned char Command_hash(unsigned char* word, unsigned char length);
+unsigned char Command_arg(unsigned char* text);
+void Command_value(const char* label, unsigned long value);
+unsigned char Crc8_update(unsigned char crc, unsigned char data);
+unsigned char dec2Buff(unsigned long val, char* buffer);
+
+#endif
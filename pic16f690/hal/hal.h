@@ -0,0 +1,87 @@
+/*
+Hardware abstraction for the PIC16F690 programs
+
+Include this in place of <pic16f690.h>.  Built
+with SDCC it is just the device header.  Built
+with gcc/clang on linux it pulls in a software
+model of the register file, see pic16f690_host.c,
+so the same main.c runs as a normal program.
+
+HAL_INTERRUPT(name) - declare the isr, replaces
+static void name(void) __interrupt 0
+
+HAL_POLL(cycles) - put in busy loops in the main
+line code.  On the host it lets the simulated
+hardware run for about as many instruction cycles
+as one pass of the loop takes, and takes any
+interrupts that come up.  Nothing on the target.
+
+HAL_SYNC() - same, one cycle and no interrupts.
+For wait loops inside the isr.
+
+HAL_NOP(), HAL_NOP2() - one and two instruction
+cycles, nop and goto $+1.  On the host they run
+the simulated hardware as long.
+
+HAL_SLEEP() - sleep, and the nop the datasheet
+wants after it, the instruction after SLEEP is
+already fetched when the part wakes.  On the
+host the model runs on to the wake up.
+
+HAL_DELAY_CYCLES(n) - cycle exact delay, n a
+constant 0 - 63.  The if's fold at compile time
+and leave only the runs of nops, no loop and no
+call.  For pin timing inside the isr, see
+Gate_flush in timer1.
+
+HAL_DELAY_US(us) - the same in micro seconds,
+from SYSTEM_CLOCK, rounded down to whole cycles.
+us a constant, at most 63 cycles - 31us at 8mhz,
+63us at 4mhz.  Longer is a compile error (array
+of size -1), those go on timer2, see Delay_us in
+common/timer2.c.
+
+*/
+#ifndef __HAL_H
+#define __HAL_H
+
+#ifdef __SDCC
+
+#include <pic16f690.h>
+
+#define HAL_INTERRUPT(name)     static void name(void) __interrupt 0
+#define HAL_POLL(cycles)
+#define HAL_SYNC()
+#define HAL_NOP()               __asm nop __endasm
+#define HAL_NOP2()              __asm goto $+1 __endasm
+#define HAL_SLEEP()             do { __asm sleep __endasm; __asm nop __endasm; } while (0)
+
+#else
+
+#include "pic16f690_host.h"
+
+#endif
+
+#define HAL_NOP8()              do { HAL_NOP2(); HAL_NOP2(); HAL_NOP2(); HAL_NOP2(); } while (0)
+
+#define HAL_DELAY_CYCLES(n)                                 \
+    do {                                                    \
+        if ((n) & 0x01) { HAL_NOP(); }                      \
+        if ((n) & 0x02) { HAL_NOP2(); }                     \
+        if ((n) & 0x04) { HAL_NOP2(); HAL_NOP2(); }         \
+        if ((n) & 0x08) { HAL_NOP8(); }                     \
+        if ((n) & 0x10) { HAL_NOP8(); HAL_NOP8(); }         \
+        if ((n) & 0x20) { HAL_NOP8(); HAL_NOP8();           \
+                          HAL_NOP8(); HAL_NOP8(); }         \
+    } while (0)
+
+#define HAL_US_CYCLES(us)       ((us) * (SYSTEM_CLOCK / 1000) / 4000)
+
+#define HAL_DELAY_US(us)                                    \
+    do {                                                    \
+        (void)sizeof(char[(HAL_US_CYCLES(us) <= 63)         \
+                          ? 1 : -1]);                       \
+        HAL_DELAY_CYCLES(HAL_US_CYCLES(us));                \
+    } while (0)
+
+#endif
@@ -0,0 +1,775 @@
+/*
+PIC16F690 model for host builds
+
+Steps the part one instruction cycle at a time
+(fosc/4, fosc from OSCCON) and runs the timers,
+CCP1 and the EUSART off the same registers the
+program writes.  The program runs between steps,
+time only moves in HAL_POLL / HAL_SYNC, see hal.h.
+
+Modelled:
+Timer0 - timer or T0CKI counter, prescaler, T0IF
+Timer1 - internal clock, prescaler, TMR1IF
+Timer2 - prescaler, PR2 match, postscaler, TMR2IF
+CCP1 - capture (RC5) and compare, CCP1IF
+EUSART - async tx/rx at the programmed baud rate,
+2 byte rx fifo, OERR, TXIF/RCIF/TRMT, WUE, ABDEN
+auto-baud
+Interrupts - GIE, PEIE, the enable/flag pairs.
+The isr body runs HOST_ISR_ENTRY cycles after the
+flag (latency and context save), then takes
+HOST_ISR_CYCLES more.
+IOC - RA2 changes set RABIF when IOCA2 is set
+WDT - software enable (SWDTEN), WDTPS and the
+OPTION postscale when PSA is set, 31khz
+SLEEP - fosc stops, the timers, CCP1 and eusart
+with it.  Wakes on a wdt time out, or any enabled
+interrupt flag (GIE does not matter).  A wdt time
+out while awake is a reset, the run ends there.
+
+With WUE set the next rx byte only wakes the part,
+it reads back as 0x00.  Bytes that come in asleep
+without WUE wait in stdin until the part wakes.
+
+With ABDEN set the next rx byte is taken as the
+auto-baud 'U', SPBRGH:SPBRG get the count for the
+host baud rate in the programmed BRG16/BRGH mode
+(ABDOVF past 0xFFFF), ABDEN clears and RCIF is set
+with a junk 0x00 to read, same as the part.
+
+A write to TMR0, TMR1L/H or TMR2 is seen at the
+next step and clears the prescaler, same as the
+part.  Sync delays are not modelled.
+
+Environment:
+HOST_SIGNAL_HZ - square wave on RA2 (T0CKI) and
+RC5 (CCP1).  Not set - RA2 and RC5 follow the RC3
+output, the loopback wire on the board.
+HOST_RUN_SECONDS - simulated run time, default 10.
+HOST_BAUD - baud rate of the host end of the
+serial line.  Not set - whatever the part is
+programmed for.  Off by more than 3% from the
+part and bytes both ways read as 0xFF.
+
+Transmitted bytes go to stdout.  If stdin is not
+a terminal it is fed to the receiver at the baud
+rate.  Run stats go to stderr at exit.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "pic16f690_host.h"
+
+////////////////////////////////////////////////
+//register file
+volatile __INTCONbits_t INTCONbits;
+volatile __PIR1bits_t PIR1bits;
+volatile __PIE1bits_t PIE1bits;
+volatile __OPTION_REGbits_t OPTION_REGbits;
+volatile __T1CONbits_t T1CONbits;
+volatile __T2CONbits_t T2CONbits;
+volatile __TXSTAbits_t TXSTAbits;
+volatile __RCSTAbits_t RCSTAbits;
+volatile __BAUDCTLbits_t BAUDCTLbits;
+volatile __WDTCONbits_t WDTCONbits;
+volatile __PORTAbits_t PORTAbits;
+volatile __PORTBbits_t PORTBbits;
+volatile __PORTCbits_t PORTCbits;
+volatile __TRISAbits_t TRISAbits;
+volatile __TRISCbits_t TRISCbits;
+volatile __IOCAbits_t IOCAbits;
+
+volatile unsigned char TMR0;
+volatile unsigned char TMR1L;
+volatile unsigned char TMR1H;
+volatile unsigned char TMR2;
+volatile unsigned char PR2;
+volatile unsigned char CCPR1L;
+volatile unsigned char CCPR1H;
+volatile unsigned char CCP1CON;
+volatile unsigned char PIR2;
+volatile unsigned char PIE2;
+volatile unsigned char OSCCON;
+volatile unsigned char OSCTUNE;
+volatile unsigned char SPBRG;
+volatile unsigned char SPBRGH;
+volatile unsigned char TRISB;
+volatile unsigned char ANSEL;
+volatile unsigned char ANSELH;
+volatile unsigned char WPUA;
+volatile unsigned char WPUB;
+volatile unsigned char IOCB;
+volatile unsigned int TXREG;
+
+
+////////////////////////////////////////////////
+//simulator state
+#define HOST_ISR_ENTRY      15          //latency, context save, first checks
+#define HOST_ISR_CYCLES     15          //rest of it, restore, retfie
+#define HOST_RX_CHUNK       256
+#define HOST_RX_RETRY       10000       //cycles between empty stdin reads
+
+static void (*gIsr)(void) = 0;
+
+static unsigned long long gCycles = 0;
+static unsigned long long gTimePs = 0;
+static unsigned long long gRunPs = 0;
+static unsigned long long gCyclePs = 0;
+static unsigned long gInterrupts = 0;
+static unsigned long gSleeps = 0;
+static unsigned long long gSleepPs = 0;
+static unsigned char gOsccon = 0xFF;
+static struct timespec gStart;
+
+//input signal, phase is 32.32 fixed point
+//periods, high for the first half
+static double gSignalHz = 0.0;
+static unsigned long long gSignalPhase = 0;
+static unsigned long long gSignalInc = 0;
+static unsigned char gSignalLevel = 0;
+static unsigned char gRa2Level = 0;
+static unsigned char gRc5Level = 0;
+static unsigned int gRa2Rise = 0;
+static unsigned int gRa2Fall = 0;
+static unsigned int gRc5Rise = 0;
+static unsigned int gRc5Fall = 0;
+
+//watchdog, time since the last clear
+#define HOST_WDT_TICK_PS    (1000000000000ULL / 31000)
+
+static unsigned long long gWdtPs = 0;
+static unsigned char gWdtWake = 0;
+
+static unsigned char gTmr0 = 0;
+static unsigned int gT0Prescale = 0;
+static unsigned int gTmr1 = 0;
+static unsigned char gT1Prescale = 0;
+static unsigned char gTmr2 = 0;
+static unsigned char gT2con = 0;
+static unsigned char gT2Prescale = 0;
+static unsigned char gT2Postscale = 0;
+static unsigned char gCcp1con = 0;
+static unsigned char gCcpPrescale = 0;
+
+static unsigned long gTxBusy = 0;
+static unsigned char gTsr = 0;
+static unsigned long gRxBusy = 0;
+static unsigned char gRsr = 0;
+static unsigned char gRxFifo[2];
+static unsigned char gRxCount = 0;
+
+static unsigned char gRxInput = 0;      //stdin is fed to the receiver
+static unsigned char gRxChunk[HOST_RX_CHUNK];
+static int gRxChunkLength = 0;
+static int gRxChunkIndex = 0;
+static unsigned long gRxRetry = 0;
+static double gHostBaud = 0.0;          //0 - follows the part
+static unsigned char gRxAutoBaud = 0;   //byte in the rsr is the ABD 'U'
+
+
+static void Host_exit(void);
+
+
+////////////////////////////////////////////////
+//fosc from the IRCF bits, 31khz at 000
+static void Host_clockUpdate(void)
+{
+    static const unsigned long fosc[8] = {
+        31000, 125000, 250000, 500000, 1000000, 2000000, 4000000, 8000000
+    };
+
+    gOsccon = OSCCON & 0x70;
+    gCyclePs = 4000000000000ULL / fosc[gOsccon >> 4];
+    gSignalInc = (unsigned long long)(gSignalHz * 4294967296.0 * (double)gCyclePs / 1e12 + 0.5);
+}
+
+
+////////////////////////////////////////////////
+//power on values, datasheet table 2-1
+static void __attribute__((constructor)) Host_init(void)
+{
+    const char* env;
+
+    INTCON = 0x00;
+    PIR1 = 0x00;
+    PIE1 = 0x00;
+    OPTION_REG = 0xFF;
+    T1CON = 0x00;
+    T2CON = 0x00;
+    PR2 = 0xFF;
+    TXSTA = 0x02;
+    RCSTA = 0x00;
+    BAUDCTL = 0x40;
+    WDTCON = 0x08;
+    PORTA = 0x00;
+    PORTB = 0x00;
+    PORTC = 0x00;
+    TRISA = 0x3F;
+    TRISB = 0xF0;
+    TRISC = 0xFF;
+    ANSEL = 0xFF;
+    ANSELH = 0x0F;
+    WPUA = 0x37;
+    WPUB = 0xF0;
+    OSCCON = 0x68;      //4mhz
+    TXREG = HOST_TXREG_EMPTY;
+
+    env = getenv("HOST_SIGNAL_HZ");
+    if (env)
+        gSignalHz = atof(env);
+
+    env = getenv("HOST_BAUD");
+    if (env)
+        gHostBaud = atof(env);
+
+    env = getenv("HOST_RUN_SECONDS");
+    gRunPs = (unsigned long long)((env ? atof(env) : 10.0) * 1e12);
+
+    if (!isatty(0))
+    {
+        fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+        gRxInput = 1;
+    }
+
+    Host_clockUpdate();
+    clock_gettime(CLOCK_MONOTONIC, &gStart);
+}
+
+
+void Host_setIsr(void (*isr)(void))
+{
+    gIsr = isr;
+}
+
+
+////////////////////////////////////////////////
+//Next byte for the receiver from stdin, -1 if
+//there is none yet.  An empty non-blocking read
+//is retried every HOST_RX_RETRY cycles only.
+static int Host_rxNext(void)
+{
+    if (gRxChunkIndex < gRxChunkLength)
+        return gRxChunk[gRxChunkIndex++];
+
+    if (!gRxInput)
+        return -1;
+
+    if (gRxRetry)
+    {
+        gRxRetry--;
+        return -1;
+    }
+
+    gRxChunkIndex = 0;
+    gRxChunkLength = (int)read(0, gRxChunk, HOST_RX_CHUNK);
+    if (gRxChunkLength > 0)
+        return gRxChunk[gRxChunkIndex++];
+
+    if ((gRxChunkLength < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        gRxRetry = HOST_RX_RETRY;
+    else
+        gRxInput = 0;       //eof
+
+    gRxChunkLength = 0;
+    return -1;
+}
+
+
+////////////////////////////////////////////////
+//Start bit with WUE set, the byte is taken as
+//the wake up and reads as 0x00.  WUE clears.
+static void Host_rxWake(void)
+{
+    WUE = 0;
+    if (gRxCount < 2)
+        gRxFifo[gRxCount++] = 0x00;
+    RCIF = 1;
+}
+
+
+////////////////////////////////////////////////
+//Instruction cycles per bit, table 12-3
+static unsigned long Host_bitCycles(void)
+{
+    unsigned long n;
+
+    if (BRG16)
+        n = ((unsigned long)SPBRGH << 8) | SPBRG;
+    else
+        n = SPBRG;
+
+    if (!BRG16 && !BRGH)
+        return 16 * (n + 1);        //fosc / 64
+    else if (BRG16 && BRGH)
+        return n + 1;               //fosc / 4
+    return 4 * (n + 1);             //fosc / 16
+}
+
+
+////////////////////////////////////////////////
+//Host end of the line, instruction cycles per
+//bit, and whether the two ends agree to 3%
+static unsigned long Host_lineCycles(void)
+{
+    if (gHostBaud <= 0.0)
+        return Host_bitCycles();
+    return (unsigned long)(1e12 / (double)gCyclePs / gHostBaud + 0.5);
+}
+
+
+static unsigned char Host_baudMatch(void)
+{
+    double part, line;
+
+    part = (double)Host_bitCycles();
+    line = (double)Host_lineCycles();
+    return (part > line ? part - line : line - part) <= line * 0.03;
+}
+
+
+////////////////////////////////////////////////
+//End of the ABD 'U', the brg count for one bit
+//at the host rate in the programmed mode
+static void Host_rxAutoBaud(void)
+{
+    unsigned long n = Host_lineCycles();
+
+    if (!BRG16 && !BRGH)
+        n /= 16;
+    else if (!(BRG16 && BRGH))
+        n /= 4;
+    n = n ? n - 1 : 0;
+
+    if (n > 0xFFFF)
+    {
+        ABDOVF = 1;         //ABDEN stays set, as the part
+        return;
+    }
+
+    SPBRGH = (unsigned char)(n >> 8);
+    SPBRG = (unsigned char)n;
+    ABDEN = 0;
+    if (gRxCount < 2)
+        gRxFifo[gRxCount++] = 0x00;
+}
+
+
+unsigned char Host_readRCREG(void)
+{
+    unsigned char c = gRxFifo[0];
+
+    if (gRxCount)
+    {
+        gRxFifo[0] = gRxFifo[1];
+        gRxCount--;
+    }
+    RCIF = (gRxCount != 0);
+
+    return c;
+}
+
+
+////////////////////////////////////////////////
+//Input signal for one cycle, generator or the RC3
+//loopback.  Edges on RA2 and RC5 go in gRa2Rise
+//etc, RA2 changes set RABIF with IOCA2 set.
+static void Host_signal(void)
+{
+    unsigned long long p0, p1;
+    unsigned char level;
+
+    if (gSignalInc)
+    {
+        p0 = gSignalPhase;
+        p1 = p0 + gSignalInc;
+        gSignalPhase = p1;
+
+        gRa2Rise = (unsigned int)((p1 >> 32) - (p0 >> 32));
+        gRa2Fall = (unsigned int)(((p1 + 0x80000000ULL) >> 32) - ((p0 + 0x80000000ULL) >> 32));
+        gSignalLevel = !((p1 >> 31) & 1);
+    }
+    else
+    {
+        level = (PORTC >> 3) & 1;
+        gRa2Rise = (level && !gSignalLevel);
+        gRa2Fall = (!level && gSignalLevel);
+        gSignalLevel = level;
+    }
+    gRc5Rise = gRa2Rise;
+    gRc5Fall = gRa2Fall;
+
+    //RA2 driven as an output follows its latch
+    if (TRISA & (1u << 2))
+    {
+        if (gSignalLevel)
+            PORTA |= (1u << 2);
+        else
+            PORTA &=~ (1u << 2);
+    }
+    else
+    {
+        level = (PORTA >> 2) & 1;
+        gRa2Rise = (level && !gRa2Level);
+        gRa2Fall = (!level && gRa2Level);
+    }
+    gRa2Level = (PORTA >> 2) & 1;
+
+    if (TRISC & (1u << 5))
+    {
+        if (gSignalLevel)
+            PORTC |= (1u << 5);
+        else
+            PORTC &=~ (1u << 5);
+    }
+    else
+    {
+        level = (PORTC >> 5) & 1;
+        gRc5Rise = (level && !gRc5Level);
+        gRc5Fall = (!level && gRc5Level);
+    }
+    gRc5Level = (PORTC >> 5) & 1;
+
+    //IOC, input pins only
+    if ((gRa2Rise || gRa2Fall) && (IOCA & TRISA & (1u << 2)))
+        RABIF = 1;
+}
+
+
+////////////////////////////////////////////////
+//Watchdog period, WDTPS on the 31khz lfintosc,
+//then the OPTION postscale if PSA gives it to
+//the wdt.  Time out is true once it has run out.
+static unsigned char Host_wdt(unsigned long long ps)
+{
+    unsigned long long period;
+
+    if (!SWDTEN)
+    {
+        gWdtPs = 0;
+        return 0;
+    }
+
+    period = (32ULL << ((WDTCON >> 1) & 0x0F)) * HOST_WDT_TICK_PS;
+    if (PSA)
+        period <<= (OPTION_REG & 0x07);
+
+    gWdtPs += ps;
+    if (gWdtPs < period)
+        return 0;
+
+    gWdtPs = 0;
+    return 1;
+}
+
+
+////////////////////////////////////////////////
+//One instruction cycle of every peripheral
+static void Host_cycle(void)
+{
+    unsigned int inc;
+    int c;
+
+    if ((OSCCON & 0x70) != gOsccon)
+        Host_clockUpdate();
+
+    gCycles++;
+    gTimePs += gCyclePs;
+    if (gTimePs >= gRunPs)
+        Host_exit();
+
+    Host_signal();
+
+    if (Host_wdt(gCyclePs))
+    {
+        fprintf(stderr, "host: watchdog reset\n");
+        Host_exit();
+    }
+
+    ////////////////////////////////////
+    //timer0
+    if (TMR0 != gTmr0)
+        gT0Prescale = 0;        //written
+
+    if (T0CS)
+        inc = T0SE ? gRa2Fall : gRa2Rise;
+    else
+        inc = 1;
+
+    if (inc && !PSA)
+    {
+        gT0Prescale += inc;
+        inc = gT0Prescale >> ((OPTION_REG & 0x07) + 1);
+        gT0Prescale &= (2u << (OPTION_REG & 0x07)) - 1;
+    }
+
+    while (inc--)
+    {
+        TMR0++;
+        if (!TMR0)
+            T0IF = 1;
+    }
+    gTmr0 = TMR0;
+
+    ////////////////////////////////////
+    //timer1 and CCP1 compare
+    if (gTmr1 != (((unsigned int)TMR1H << 8) | TMR1L))
+    {
+        gTmr1 = ((unsigned int)TMR1H << 8) | TMR1L;
+        gT1Prescale = 0;        //written
+    }
+
+    if (TMR1ON && !TMR1CS)
+    {
+        gT1Prescale++;
+        if (gT1Prescale >= (1u << ((T1CON >> 4) & 0x03)))
+        {
+            gT1Prescale = 0;
+            gTmr1 = (gTmr1 + 1) & 0xFFFF;
+            if (!gTmr1)
+                TMR1IF = 1;
+
+            if (((CCP1CON & 0x0C) == 0x08) &&
+                (gTmr1 == (((unsigned int)CCPR1H << 8) | CCPR1L)))
+            {
+                CCP1IF = 1;
+                if ((CCP1CON & 0x0F) == 0x0B)
+                    gTmr1 = 0;      //special event trigger
+            }
+        }
+    }
+    TMR1L = (unsigned char)gTmr1;
+    TMR1H = (unsigned char)(gTmr1 >> 8);
+
+    ////////////////////////////////////
+    //CCP1 capture, prescaler clears on a mode change
+    if (CCP1CON != gCcp1con)
+    {
+        gCcp1con = CCP1CON;
+        gCcpPrescale = 0;
+    }
+
+    if (((CCP1CON & 0x0F) >= 0x04) && ((CCP1CON & 0x0F) <= 0x07))
+    {
+        inc = ((CCP1CON & 0x0F) == 0x04) ? gRc5Fall : gRc5Rise;
+        if (inc)
+        {
+            unsigned char every = 1;
+
+            if ((CCP1CON & 0x0F) == 0x06)
+                every = 4;
+            else if ((CCP1CON & 0x0F) == 0x07)
+                every = 16;
+
+            gCcpPrescale += inc;
+            if (gCcpPrescale >= every)
+            {
+                gCcpPrescale %= every;
+                CCPR1L = TMR1L;
+                CCPR1H = TMR1H;
+                CCP1IF = 1;
+            }
+        }
+    }
+
+    ////////////////////////////////////
+    //timer2, TMR2 or T2CON writes clear the scalers
+    if ((TMR2 != gTmr2) || (T2CON != gT2con))
+    {
+        gT2Prescale = 0;
+        gT2Postscale = 0;
+        gT2con = T2CON;
+    }
+
+    if (TMR2ON)
+    {
+        gT2Prescale++;
+        if (gT2Prescale >= ((T2CON & 0x02) ? 16 : ((T2CON & 0x01) ? 4 : 1)))
+        {
+            gT2Prescale = 0;
+            if (TMR2 == PR2)
+            {
+                TMR2 = 0x00;
+                gT2Postscale++;
+                if (gT2Postscale > ((T2CON >> 3) & 0x0F))
+                {
+                    gT2Postscale = 0;
+                    TMR2IF = 1;
+                }
+            }
+            else
+                TMR2++;
+        }
+    }
+    gTmr2 = TMR2;
+
+    ////////////////////////////////////
+    //eusart transmit
+    if (SPEN && TXEN)
+    {
+        if (gTxBusy && !--gTxBusy)
+        {
+            putchar(Host_baudMatch() ? gTsr : 0xFF);
+            TRMT = 1;
+        }
+
+        if (!gTxBusy && (TXREG != HOST_TXREG_EMPTY))
+        {
+            gTsr = (unsigned char)TXREG;
+            TXREG = HOST_TXREG_EMPTY;
+            gTxBusy = 10 * Host_bitCycles();
+            TRMT = 0;
+        }
+    }
+    TXIF = (TXREG == HOST_TXREG_EMPTY);
+
+    ////////////////////////////////////
+    //eusart receive, clearing CREN clears OERR
+    if (SPEN && CREN)
+    {
+        if (gRxBusy && !--gRxBusy)
+        {
+            if (gRxAutoBaud)
+                Host_rxAutoBaud();
+            else if (gRxCount < 2)
+                gRxFifo[gRxCount++] = Host_baudMatch() ? gRsr : 0xFF;
+            else
+                OERR = 1;
+            gRxAutoBaud = 0;
+        }
+
+        if (!gRxBusy && !OERR)
+        {
+            c = Host_rxNext();
+            if ((c >= 0) && WUE)
+                Host_rxWake();
+            else if (c >= 0)
+            {
+                gRsr = (unsigned char)c;
+                gRxAutoBaud = ABDEN;
+                gRxBusy = 10 * Host_lineCycles();
+            }
+        }
+    }
+    else if (!CREN)
+        OERR = 0;
+    RCIF = (gRxCount != 0);
+}
+
+
+////////////////////////////////////////////////
+//Any enabled interrupt with its flag set, GIE
+//aside.  Wakes the part from sleep.
+static unsigned char Host_flagged(void)
+{
+    //T0IE/T0IF, INTE/INTF, RABIE/RABIF
+    if ((INTCON & 0x38) & ((INTCON & 0x07) << 3))
+        return 1;
+
+    if (PEIE && ((PIE1 & PIR1) || (PIE2 & PIR2)))
+        return 1;
+
+    return 0;
+}
+
+
+////////////////////////////////////////////////
+//Interrupt to take now
+static unsigned char Host_pending(void)
+{
+    return GIE && gIsr && Host_flagged();
+}
+
+
+void Host_poll(unsigned int cycles)
+{
+    unsigned int i;
+
+    while (cycles--)
+    {
+        Host_cycle();
+
+        if (Host_pending())
+        {
+            GIE = 0;
+            gInterrupts++;
+
+            //the isr looks at the flags this late,
+            //any that came up meanwhile are seen too
+            for (i = 0 ; i < HOST_ISR_ENTRY ; i++)
+                Host_cycle();
+
+            gIsr();
+            GIE = 1;        //retfie
+
+            for (i = 0 ; i < HOST_ISR_CYCLES ; i++)
+                Host_cycle();
+        }
+    }
+}
+
+
+void Host_sync(void)
+{
+    Host_cycle();
+}
+
+
+////////////////////////////////////////////////
+//SLEEP - clears the wdt and stops everything on
+//fosc.  Time runs on in cycle steps for the
+//input signal, IOC, WUE and the wdt until one
+//of them wakes the part.  An interrupt that is
+//already flagged makes it a nop.  Any isr is
+//taken at the next HAL_POLL, after the wake.
+void Host_sleep(void)
+{
+    int c;
+
+    gWdtPs = 0;
+    gWdtWake = 0;
+    gSleeps++;
+
+    while (!gWdtWake && !Host_flagged())
+    {
+        gTimePs += gCyclePs;
+        gSleepPs += gCyclePs;
+        if (gTimePs >= gRunPs)
+            Host_exit();
+
+        Host_signal();
+        gWdtWake = Host_wdt(gCyclePs);
+
+        if (SPEN && CREN && WUE)
+        {
+            c = Host_rxNext();
+            if (c >= 0)
+                Host_rxWake();
+        }
+    }
+}
+
+
+static void Host_exit(void)
+{
+    struct timespec now;
+    double real, sim;
+
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    real = (now.tv_sec - gStart.tv_sec) + (now.tv_nsec - gStart.tv_nsec) / 1e9;
+    sim = gTimePs / 1e12;
+
+    fprintf(stderr, "host: %.3f s simulated, %llu cycles, %lu interrupts, %.3f s real (%.1fx)\n",
+            sim, gCycles, gInterrupts, real, real > 0 ? sim / real : 0.0);
+    if (gSleeps)
+        fprintf(stderr, "host: %lu sleeps, %.3f s asleep\n", gSleeps, gSleepPs / 1e12);
+
+    exit(0);
+}
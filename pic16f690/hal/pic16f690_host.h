@@ -0,0 +1,432 @@
+/*
+PIC16F690 register file for host builds
+
+Same names as the SDCC device header, registers
+are plain bytes and the bit names go through the
+xxxbits unions the same way, so the program code
+does not change.  The peripherals behind them are
+modelled in pic16f690_host.c.
+
+Differences from the part:
+TXREG - reads back HOST_TXREG_EMPTY once the
+byte has moved to the shift register.
+RCREG - read only, each read pops the fifo.
+
+*/
+#ifndef __PIC16F690_HOST_H
+#define __PIC16F690_HOST_H
+
+#define __code
+#define __at(addr)
+
+////////////////////////////////////////////////
+//config word, not used on the host
+#define _CP_OFF             0x3FFF
+#define _CPD_OFF            0x3FFF
+#define _BOREN_OFF          0x3CFF
+#define _WDTE_OFF           0x3FF7
+#define _WDTE_ON            0x3FFF
+#define _MCLRE_OFF          0x3FDF
+#define _PWRTE_OFF          0x3FFF
+#define _IESO_OFF           0x3BFF
+#define _FCMEN_OFF          0x37FF
+#define _FOSC_INTRCIO       0x3FFC
+#define _FOSC_INTRCCLK      0x3FFD
+
+
+////////////////////////////////////////////////
+//registers with named bits
+typedef union
+{
+    struct
+    {
+        unsigned char RABIF:1;
+        unsigned char INTF:1;
+        unsigned char T0IF:1;
+        unsigned char RABIE:1;
+        unsigned char INTE:1;
+        unsigned char T0IE:1;
+        unsigned char PEIE:1;
+        unsigned char GIE:1;
+    };
+    unsigned char reg;
+} __INTCONbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TMR1IF:1;
+        unsigned char TMR2IF:1;
+        unsigned char CCP1IF:1;
+        unsigned char SSPIF:1;
+        unsigned char TXIF:1;
+        unsigned char RCIF:1;
+        unsigned char ADIF:1;
+        unsigned char :1;
+    };
+    unsigned char reg;
+} __PIR1bits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TMR1IE:1;
+        unsigned char TMR2IE:1;
+        unsigned char CCP1IE:1;
+        unsigned char SSPIE:1;
+        unsigned char TXIE:1;
+        unsigned char RCIE:1;
+        unsigned char ADIE:1;
+        unsigned char :1;
+    };
+    unsigned char reg;
+} __PIE1bits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char PS0:1;
+        unsigned char PS1:1;
+        unsigned char PS2:1;
+        unsigned char PSA:1;
+        unsigned char T0SE:1;
+        unsigned char T0CS:1;
+        unsigned char INTEDG:1;
+        unsigned char NOT_RABPU:1;
+    };
+    unsigned char reg;
+} __OPTION_REGbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TMR1ON:1;
+        unsigned char TMR1CS:1;
+        unsigned char NOT_T1SYNC:1;
+        unsigned char T1OSCEN:1;
+        unsigned char T1CKPS0:1;
+        unsigned char T1CKPS1:1;
+        unsigned char TMR1GE:1;
+        unsigned char T1GINV:1;
+    };
+    unsigned char reg;
+} __T1CONbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char T2CKPS0:1;
+        unsigned char T2CKPS1:1;
+        unsigned char TMR2ON:1;
+        unsigned char TOUTPS0:1;
+        unsigned char TOUTPS1:1;
+        unsigned char TOUTPS2:1;
+        unsigned char TOUTPS3:1;
+        unsigned char :1;
+    };
+    unsigned char reg;
+} __T2CONbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TX9D:1;
+        unsigned char TRMT:1;
+        unsigned char BRGH:1;
+        unsigned char SENDB:1;
+        unsigned char SYNC:1;
+        unsigned char TXEN:1;
+        unsigned char TX9:1;
+        unsigned char CSRC:1;
+    };
+    unsigned char reg;
+} __TXSTAbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char RX9D:1;
+        unsigned char OERR:1;
+        unsigned char FERR:1;
+        unsigned char ADDEN:1;
+        unsigned char CREN:1;
+        unsigned char SREN:1;
+        unsigned char RX9:1;
+        unsigned char SPEN:1;
+    };
+    unsigned char reg;
+} __RCSTAbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char ABDEN:1;
+        unsigned char WUE:1;
+        unsigned char :1;
+        unsigned char BRG16:1;
+        unsigned char SCKP:1;
+        unsigned char :1;
+        unsigned char RCIDL:1;
+        unsigned char ABDOVF:1;
+    };
+    unsigned char reg;
+} __BAUDCTLbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char SWDTEN:1;
+        unsigned char WDTPS0:1;
+        unsigned char WDTPS1:1;
+        unsigned char WDTPS2:1;
+        unsigned char WDTPS3:1;
+        unsigned char :3;
+    };
+    unsigned char reg;
+} __WDTCONbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char RA0:1;
+        unsigned char RA1:1;
+        unsigned char RA2:1;
+        unsigned char RA3:1;
+        unsigned char RA4:1;
+        unsigned char RA5:1;
+        unsigned char :2;
+    };
+    unsigned char reg;
+} __PORTAbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char :4;
+        unsigned char RB4:1;
+        unsigned char RB5:1;
+        unsigned char RB6:1;
+        unsigned char RB7:1;
+    };
+    unsigned char reg;
+} __PORTBbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char RC0:1;
+        unsigned char RC1:1;
+        unsigned char RC2:1;
+        unsigned char RC3:1;
+        unsigned char RC4:1;
+        unsigned char RC5:1;
+        unsigned char RC6:1;
+        unsigned char RC7:1;
+    };
+    unsigned char reg;
+} __PORTCbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TRISA0:1;
+        unsigned char TRISA1:1;
+        unsigned char TRISA2:1;
+        unsigned char TRISA3:1;
+        unsigned char TRISA4:1;
+        unsigned char TRISA5:1;
+        unsigned char :2;
+    };
+    unsigned char reg;
+} __TRISAbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char TRISC0:1;
+        unsigned char TRISC1:1;
+        unsigned char TRISC2:1;
+        unsigned char TRISC3:1;
+        unsigned char TRISC4:1;
+        unsigned char TRISC5:1;
+        unsigned char TRISC6:1;
+        unsigned char TRISC7:1;
+    };
+    unsigned char reg;
+} __TRISCbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned char IOCA0:1;
+        unsigned char IOCA1:1;
+        unsigned char IOCA2:1;
+        unsigned char IOCA3:1;
+        unsigned char IOCA4:1;
+        unsigned char IOCA5:1;
+        unsigned char :2;
+    };
+    unsigned char reg;
+} __IOCAbits_t;
+
+extern volatile __INTCONbits_t INTCONbits;
+extern volatile __PIR1bits_t PIR1bits;
+extern volatile __PIE1bits_t PIE1bits;
+extern volatile __OPTION_REGbits_t OPTION_REGbits;
+extern volatile __T1CONbits_t T1CONbits;
+extern volatile __T2CONbits_t T2CONbits;
+extern volatile __TXSTAbits_t TXSTAbits;
+extern volatile __RCSTAbits_t RCSTAbits;
+extern volatile __BAUDCTLbits_t BAUDCTLbits;
+extern volatile __WDTCONbits_t WDTCONbits;
+extern volatile __PORTAbits_t PORTAbits;
+extern volatile __PORTBbits_t PORTBbits;
+extern volatile __PORTCbits_t PORTCbits;
+extern volatile __TRISAbits_t TRISAbits;
+extern volatile __TRISCbits_t TRISCbits;
+extern volatile __IOCAbits_t IOCAbits;
+
+#define INTCON          INTCONbits.reg
+#define PIR1            PIR1bits.reg
+#define PIE1            PIE1bits.reg
+#define OPTION_REG      OPTION_REGbits.reg
+#define T1CON           T1CONbits.reg
+#define T2CON           T2CONbits.reg
+#define TXSTA           TXSTAbits.reg
+#define RCSTA           RCSTAbits.reg
+#define BAUDCTL         BAUDCTLbits.reg
+#define WDTCON          WDTCONbits.reg
+#define PORTA           PORTAbits.reg
+#define PORTB           PORTBbits.reg
+#define PORTC           PORTCbits.reg
+#define TRISA           TRISAbits.reg
+#define TRISC           TRISCbits.reg
+#define IOCA            IOCAbits.reg
+
+//bits
+#define RABIF           INTCONbits.RABIF
+#define INTF            INTCONbits.INTF
+#define T0IF            INTCONbits.T0IF
+#define RABIE           INTCONbits.RABIE
+#define INTE            INTCONbits.INTE
+#define T0IE            INTCONbits.T0IE
+#define PEIE            INTCONbits.PEIE
+#define GIE             INTCONbits.GIE
+
+#define TMR1IF          PIR1bits.TMR1IF
+#define TMR2IF          PIR1bits.TMR2IF
+#define CCP1IF          PIR1bits.CCP1IF
+#define TXIF            PIR1bits.TXIF
+#define RCIF            PIR1bits.RCIF
+#define ADIF            PIR1bits.ADIF
+
+#define TMR1IE          PIE1bits.TMR1IE
+#define TMR2IE          PIE1bits.TMR2IE
+#define CCP1IE          PIE1bits.CCP1IE
+#define TXIE            PIE1bits.TXIE
+#define RCIE            PIE1bits.RCIE
+#define ADIE            PIE1bits.ADIE
+
+#define PSA             OPTION_REGbits.PSA
+#define T0SE            OPTION_REGbits.T0SE
+#define T0CS            OPTION_REGbits.T0CS
+
+#define TMR1ON          T1CONbits.TMR1ON
+#define TMR1CS          T1CONbits.TMR1CS
+#define TMR2ON          T2CONbits.TMR2ON
+
+#define TRMT            TXSTAbits.TRMT
+#define BRGH            TXSTAbits.BRGH
+#define SYNC            TXSTAbits.SYNC
+#define TXEN            TXSTAbits.TXEN
+#define OERR            RCSTAbits.OERR
+#define FERR            RCSTAbits.FERR
+#define CREN            RCSTAbits.CREN
+#define SPEN            RCSTAbits.SPEN
+#define ABDEN           BAUDCTLbits.ABDEN
+#define WUE             BAUDCTLbits.WUE
+#define BRG16           BAUDCTLbits.BRG16
+#define RCIDL           BAUDCTLbits.RCIDL
+#define ABDOVF          BAUDCTLbits.ABDOVF
+#define SWDTEN          WDTCONbits.SWDTEN
+
+#define RA2             PORTAbits.RA2
+#define RC0             PORTCbits.RC0
+#define RC1             PORTCbits.RC1
+#define RC3             PORTCbits.RC3
+#define RC5             PORTCbits.RC5
+#define TRISA2          TRISAbits.TRISA2
+#define TRISC5          TRISCbits.TRISC5
+#define IOCA2           IOCAbits.IOCA2
+
+
+////////////////////////////////////////////////
+//registers without named bits
+extern volatile unsigned char TMR0;
+extern volatile unsigned char TMR1L;
+extern volatile unsigned char TMR1H;
+extern volatile unsigned char TMR2;
+extern volatile unsigned char PR2;
+extern volatile unsigned char CCPR1L;
+extern volatile unsigned char CCPR1H;
+extern volatile unsigned char CCP1CON;
+extern volatile unsigned char PIR2;
+extern volatile unsigned char PIE2;
+extern volatile unsigned char OSCCON;
+extern volatile unsigned char OSCTUNE;
+extern volatile unsigned char SPBRG;
+extern volatile unsigned char SPBRGH;
+extern volatile unsigned char TRISB;
+extern volatile unsigned char ANSEL;
+extern volatile unsigned char ANSELH;
+extern volatile unsigned char WPUA;
+extern volatile unsigned char WPUB;
+extern volatile unsigned char IOCB;
+
+//transmit holding register, HOST_TXREG_EMPTY
+//when the shift register has taken the byte
+#define HOST_TXREG_EMPTY    0x100
+extern volatile unsigned int TXREG;
+
+//receive fifo, reading pops
+#define RCREG           Host_readRCREG()
+unsigned char Host_readRCREG(void);
+
+
+////////////////////////////////////////////////
+//simulator hooks, see hal.h
+void Host_setIsr(void (*isr)(void));
+void Host_poll(unsigned int cycles);
+void Host_sync(void);
+void Host_sleep(void);
+
+#define HAL_INTERRUPT(name)                                             \
+    static void name(void);                                             \
+    static void __attribute__((constructor)) name##_register(void)      \
+    {                                                                   \
+        Host_setIsr(name);                                              \
+    }                                                                   \
+    static void name(void)
+
+#define HAL_POLL(cycles)    Host_poll(cycles)
+#define HAL_SYNC()          Host_sync()
+#define HAL_NOP()           Host_poll(1)
+#define HAL_NOP2()          Host_poll(2)
+#define HAL_SLEEP()         Host_sleep()
+
+#endif
@@ -0,0 +1,25 @@
+#!/bin/bash
+######################################
+#build script for the host (linux) version,
+#runs against the simulated registers in ../hal
+#
+#name of input file as arg, if no arg,
+#defaults to main.c
+#
+#run:
+#HOST_SIGNAL_HZ=1000 HOST_RUN_SECONDS=5 ./output_host
+NUM=$#
+INPUT_FILE="main.c"
+TARGET="output_host"
+
+if test "$NUM" -eq "1";
+then
+    INPUT_FILE=$1
+fi
+
+echo "Input file: $INPUT_FILE"
+
+CC=${CC:-gcc}
+CC_OPTIONS="-std=gnu99 -O2 -Wall -Wno-main -o $TARGET"
+
+$CC $CC_OPTIONS $INPUT_FILE ../hal/pic16f690_host.c
@@ -38,12 +38,12 @@ All interrupts - pc is loaded with 0x0004h. SDCC
 uses the following for isr with single interrupt
 value:
 
-static void irqHandler(void) __interrupt 0
+HAL_INTERRUPT(irqHandler)
 {}
 
 */
 
-#include <pic16f690.h>
+#include "../hal/hal.h"
 
 ////////////////////////////////////////////////
 //Set the appropriate config bits
@@ -52,6 +52,17 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 ////////////////////////////////////////////////
 
 
+////////////////////////////////////////////////
+//System clock, ClockConfig sets the internal osc
+//to this.  The delays work from it at compile
+//time, any of 1, 2, 4, 8mhz.  Timer2 runs free
+//with a 1ms period for Delay_ms and Delay_us,
+//its settings are in timer2.h.
+#define SYSTEM_CLOCK        8000000
+
+#include "../common/timer2.h"
+
+
 ////////////////////////////////////////////////
 //configure as timer or counter
 //define counter ro run as counter
@@ -68,6 +79,34 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 #define COUNTER_RESET     (unsigned char)(0xFF - COUNTER_TRIGGER + 1)
 
 
+////////////////////////////////////////////////
+//Low power - the main loop sleeps between passes
+//instead of spinning in Delay_ms.  The software
+//wdt (SWDTEN, off in the config word) wakes it
+//after each period, 1:512 of the 31khz lfintosc
+//is 16.5ms, untrimmed so the 50ms is loose.
+//Timer0 is synced to the core and stops in sleep,
+//but RC3 only moves while awake, so no edges are
+//missed.
+//
+//gPowerAwakeUs - timer2 ticks awake, timer2 stops
+//in sleep.  Each pass is well under the 1ms timer2
+//period, so one Timer2_elapsed per pass sees it.
+//gPowerAsleepMs - whole wdt periods, rounded down.
+//
+//Off by default, RC3 is the test signal and only
+//moves while awake.
+//#define USE_SLEEP           1
+#define POWER_WDTPS         0x04        //1:512
+#define POWER_PERIOD_MS     16
+#define POWER_SLEEP_PERIODS 3           //about 50ms
+
+#ifdef USE_SLEEP
+unsigned long gPowerAwakeUs = 0x00;
+unsigned long gPowerAsleepMs = 0x00;
+#endif
+
+
 
 //////////////////////////////////////
 //prototypes
@@ -75,9 +114,14 @@ volatile unsigned int gTimerTick = 0x00;
 unsigned int gCycleCounter = 0x00;
 
 
-void Delay(unsigned long val);
+void Delay_ms(unsigned int ms);
 void GPIO_init(void);
 void Timer0_init(void);
+void Timer2_init(void);
+unsigned char Timer2_elapsed(void);
+#ifdef USE_SLEEP
+void Power_sleep(void);
+#endif
 void ClockConfig(unsigned long hz);
 void ClockTune(unsigned char value);
 
@@ -90,7 +134,7 @@ void ClockTune(unsigned char value);
 //
 //whne configured as counter, it triggers
 //on overflow.  
-static void irqHandler(void) __interrupt 0
+HAL_INTERRUPT(irqHandler)
 {
     //test the timer 0 if
     if (T0IF == 1)
@@ -111,9 +155,10 @@ static void irqHandler(void) __interrupt 0
 /////////////////////////////////////
 int main()
 {
-    ClockConfig(8000000);   //125, 250hz, 500, 1000hz
+    ClockConfig(SYSTEM_CLOCK);  //125, 250hz, 500, 1000hz
     GPIO_init();
     Timer0_init();
+    Timer2_init();
    
     while (1)
     {
@@ -126,7 +171,11 @@ int main()
         //RA2 is pin 17
         PORTC ^= (1 << 3);
 
-        Delay(50);
+#ifdef USE_SLEEP
+        Power_sleep();
+#else
+        Delay_ms(50);
+#endif
 
         gCycleCounter++;
     }
@@ -137,21 +186,25 @@ int main()
 
 
 //////////////////////////////////////////
-//Delay function.
-//When configured as counter, the delay function
-//is not that accurate.  When configured as timer
-//the delay function works well.
-void Delay(unsigned long val)
+//Delay in ms on timer2.  Adds up the ticks
+//since the start, so time in the isr is
+//counted as long as the loop gets back
+//within 1ms.
+void Delay_ms(unsigned int ms)
 {
-#ifdef USE_COUNTER
-    volatile unsigned long temp = val * 96;
-    while (temp > 0)
-        temp--;
-#else
-    gTimerTick = 0x00;
-    while(gTimerTick < val){};
-#endif
+    unsigned int ticks = 0x00;
 
+    Timer2_elapsed();               //start from now
+    while (ms > 0)
+    {
+        HAL_POLL(30);
+        ticks += Timer2_elapsed();
+        if (ticks >= TIMER2_TICKS_PER_MS)
+        {
+            ticks -= TIMER2_TICKS_PER_MS;
+            ms--;
+        }
+    }
 }
 
 
@@ -232,6 +285,65 @@ void Timer0_init(void)
 }
 
 
+#ifdef USE_SLEEP
+//////////////////////////////////////////
+//Sleep POWER_SLEEP_PERIODS wdt periods.  The
+//wdt only runs over the sleep.
+void Power_sleep(void)
+{
+    unsigned char i;
+
+    HAL_POLL(20);           //the pass up to here
+    gPowerAwakeUs += (unsigned long)Timer2_elapsed() * TIMER2_US_PER_TICK;
+
+    WDTCON = (POWER_WDTPS << 1) | 0x01;     //SWDTEN
+    for (i = 0 ; i < POWER_SLEEP_PERIODS ; i++)
+    {
+        HAL_SLEEP();
+        gPowerAsleepMs += POWER_PERIOD_MS;
+    }
+    WDTCON = (POWER_WDTPS << 1);
+}
+#endif
+
+
+
+//////////////////////////////////////////
+//Timer2 - free running at a 1ms period, no
+//interrupt.  TMR2 is only ever read, the
+//delays count ticks from wherever it is.
+void Timer2_init(void)
+{
+    TMR2ON = 0;
+    PR2 = TIMER2_TICKS_PER_MS - 1;
+    TMR2 = 0x00;
+    T2CON = TIMER2_PRESCALE;        //postscale 1:1
+    TMR2IF = 0;
+    TMR2ON = 1;
+}
+
+
+
+//////////////////////////////////////////
+//timer2 ticks since the last call.  Needs
+//calling at least once per ms, TMR2 goes
+//back to 0 after PR2.
+unsigned char gTimer2Last = 0x00;
+
+unsigned char Timer2_elapsed(void)
+{
+    unsigned char now = TMR2;
+    unsigned char ticks = now - gTimer2Last;
+
+    if (now < gTimer2Last)
+        ticks += TIMER2_TICKS_PER_MS;
+
+    gTimer2Last = now;
+    return ticks;
+}
+
+
+
 /////////////////////////////////////
 //Configure the internal oscillator 
 //speed in hz.  For now, use, 1, 2, 4, 8mhz
@@ -281,4 +393,4 @@ void ClockTune(unsigned char value)
 }
 
 
-
+#include "../common/timer2.c"
@@ -24,7 +24,7 @@ from pile counter code.
 
 */
 
-#include <pic16f690.h>
+#include "../hal/hal.h"
 
 ////////////////////////////////////////////////
 //Set the appropriate config bits
@@ -33,6 +33,28 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 ////////////////////////////////////////////////
 
 
+////////////////////////////////////////////////
+//System clock, ClockConfig sets the internal osc
+//to this, any of 1, 2, 4, 8mhz.  The timer2 tick
+//(../common/sched.h) and the baud rate divisor
+//(../common/usart.h) work from it at compile
+//time.
+#define SYSTEM_CLOCK        8000000
+
+//usart baud rate, checked against what
+//SYSTEM_CLOCK can do, see ../common/usart.h
+#define BAUD_RATE           57600
+#define BAUD_ERROR_MAX      20                  //per mille
+
+//define USE_AUTOBAUD to listen for a 'U' at power
+//up, for AUTOBAUD_WAIT_MS, and take the rate the
+//host sends it at.  Nothing comes - BAUD_RATE.
+//The main loop stays awake till it is done, the
+//tasks run meanwhile.
+#define USE_AUTOBAUD        1
+#define AUTOBAUD_WAIT_MS    1000
+
+
 ////////////////////////////////////////////////
 //configure as timer or counter
 //define counter ro run as counter
@@ -44,18 +66,291 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 //ie, for a setting =1, if input toggles at 10 hz
 //the counter isr will toggle at 2.5 hz.
 #define USE_COUNTER       1
-#define COUNTER_TRIGGER   (unsigned char)10     //value to trigger an interrupt
-//load tmr0 reg with this value
-#define COUNTER_RESET     (unsigned char)(0xFF - COUNTER_TRIGGER + 1)
 
-//multiplier for prescale 8 and counter trigger
-#define PRESCALE_8         ((unsigned long)250000)
-#define PRESCALE_4         ((unsigned long)500000)
-#define PRESCALE_2         ((unsigned long)1000000)
+////////////////////////////////////////////////
+//Measurement ranges
+//Each range sets the timer0 reload value (the
+//counter trigger), the timer0 prescale bits in
+//OPTION_REG, the timer1 prescale bits in T1CON
+//and the matching factor:
+//
+//  edges per gate = trigger * t0 prescale
+//  freq = factor / timer1 ticks
+//  factor = edges * (fosc/4 / t1 prescale) * 10^decimals
+//
+//decimals is the number of fixed point places
+//in the result, ie range 0 reads in 0.001hz.
+//Fosc = 8mhz, so timer1 runs at 2mhz / t1 prescale.
+//
+//range  trigger  t0ps  t1ps  edges   good for (hz)
+//  0       1       2     8       2   below 125
+//  1      10       2     8      20   100 - 1250
+//  2      10       2     1      20   800 - 10k
+//  3      16       8     1     128   5k - 64k
+//  4      64      16     1    1024   40k - 512k
+//  5      64     256     8   16384   above 80k
+//
+//Range 1 is the original fixed setting, trigger
+//10, prescale 8, factor 2 * 10 * 250000.
+//
+//Ranges 6-9 are for the CCP1 capture mode, see
+//MODE_CAPTURE.  Timer0 is not used, edges per
+//gate is the CCP1 capture prescale instead.
+//
+//range  ccp1  t1ps  edges   good for (hz)
+//  6     1st    8       1   below 62
+//  7     1st    1       1   40 - 500
+//  8     4th    1       4   160 - 2000
+//  9    16th    1      16   above 640
+//
+//Ranges 10-11 are for MODE_DIRECT.  Timer0 counts
+//edges with no reload, the gate is a fixed number
+//of timer1 ticks, so the factor multiplies:
+//
+//  freq = edges * t0 prescale * 1000 / DIRECT_GATE_MS
+//
+//range  t0ps  edges per count   good for (hz)
+// 10    none         1          below 500k
+// 11      16        16          above 250k
+//
+//With USE_PRESCALER_FLUSH the prescaler residue
+//is read out at each gate close, samples are the
+//exact edge count and the factor drops t0 prescale.
+//
+//With USE_AUTORANGE the main loop watches the
+//timer1 count of each gate and steps the range
+//up when the gate is shorter than RANGE_TICKS_MIN
+//(poor resolution) or down when it is longer than
+//RANGE_TICKS_MAX (slow updates).  The bands overlap
+//by more than one step so it does not hunt.  The
+//T0IF isr applies the new range at gate close, so
+//a gate never spans two settings.
+#define USE_AUTORANGE       1
+#define RANGE_DEFAULT       1
+#define RANGE_CAPTURE       6       //first capture range
+#define RANGE_DIRECT        10      //first direct count range
+#define RANGE_MAX           11
+#define RANGE_TICKS_MIN     4000
+#define RANGE_TICKS_MAX     50000
+
+////////////////////////////////////////////////
+//Direct count gate.  CCP1 in compare mode
+//interrupts every DIRECT_GATE_TICKS of timer1
+//(100ms at the 1:8 prescale), the gate closes
+//after DIRECT_GATE_MS / 100 of them.  Use 100
+//or 1000, longer gate = finer resolution, 1hz
+//at 1000.  Auto range steps to the prescaled
+//range above DIRECT_COUNT_UP counts per gate
+//and back below DIRECT_COUNT_DOWN.
+#define DIRECT_GATE_MS      1000
+#define DIRECT_GATE_SCALE   (1000 / DIRECT_GATE_MS)
+#define DIRECT_GATE_TICKS   25000
+#define DIRECT_GATE_PERIODS (DIRECT_GATE_MS / 100)
+#define DIRECT_COUNT_UP     (500000 / DIRECT_GATE_SCALE)
+
+////////////////////////////////////////////////
+//Prescaler flush.  Edges left in the timer0
+//prescaler at gate close can't be read, so they
+//are lost and direct count is only good to the
+//prescale.  With USE_PRESCALER_FLUSH the gate
+//close holds RA2 as an output and pulses it until
+//TMR0 ticks, see Gate_flush.
+//
+//Off by default, it drives a pin the signal
+//source drives too.  Only turn it on with a
+//series resistor (1k or more) between the source
+//and RA2, so neither side sinks more than a few
+//mA into the other, and a source that can stand
+//its output pulled about once a second for the
+//length of the hold.  The RC3 loopback is an
+//output too and needs the resistor the same.
+//
+//It does not buy much.  On the host, awake,
+//1234567hz in range 11 reads 1234560-1234579
+//with the flush and 1234560 or 1234576 without.
+//The gate close latency moves about as much as
+//the prescaler residue did.
+//#define USE_PRESCALER_FLUSH 1
+
+#ifdef USE_PRESCALER_FLUSH
+#define DIRECT_FACTOR(ps)   (DIRECT_GATE_SCALE)         //samples are edges
+#define DIRECT_COUNT_DOWN   (250000 / DIRECT_GATE_SCALE)
+#else
+#define DIRECT_FACTOR(ps)   ((ps) * DIRECT_GATE_SCALE)  //samples are counts
+#define DIRECT_COUNT_DOWN   (15625 / DIRECT_GATE_SCALE)
+#endif
+
+typedef struct
+{
+    unsigned char reload;       //TMR0 load value, 256 - trigger
+    unsigned char t0ps;         //OPTION_REG bits 0-3, PSA in bit 3
+    unsigned char t1ps;         //T1CON bits 5-4
+    unsigned char ccp1con;      //CCP1CON capture mode, 0 - not used
+    unsigned char decimals;     //fixed point places in result
+    unsigned long factor;
+} Range;
+
+__code const Range gRangeTable[RANGE_MAX + 1] = {
+    {0xFF, 0x00, 0x30, 0x00, 3, 500000000},     //2 * 250k * 1000
+    {0xF6, 0x00, 0x30, 0x00, 1, 50000000},      //20 * 250k * 10
+    {0xF6, 0x00, 0x00, 0x00, 1, 400000000},     //20 * 2m * 10
+    {0xF0, 0x02, 0x00, 0x00, 1, 2560000000UL},  //128 * 2m * 10
+    {0xC0, 0x03, 0x00, 0x00, 0, 2048000000},    //1024 * 2m
+    {0xC0, 0x07, 0x30, 0x00, 0, 4096000000UL},  //16384 * 250k
+    {0x00, 0x00, 0x30, 0x05, 3, 250000000},     //1 * 250k * 1000
+    {0x00, 0x00, 0x00, 0x05, 3, 2000000000},    //1 * 2m * 1000
+    {0x00, 0x00, 0x00, 0x06, 2, 800000000},     //4 * 2m * 100
+    {0x00, 0x00, 0x00, 0x07, 2, 3200000000UL},  //16 * 2m * 100
+    {0x00, 0x08, 0x30, 0x00, 0, DIRECT_FACTOR(1)},      //prescale to wdt, 1:1
+    {0x00, 0x03, 0x30, 0x00, 0, DIRECT_FACTOR(16)}      //1:16
+};
+
+////////////////////////////////////////////////
+//Measurement modes
+//MODE_COUNTER - timer0 counts T0CKI (RA2) edges,
+//the T0IF isr timestamps the gate in software,
+//so interrupt latency jitter lands in every
+//sample.  Ranges 0-5.
+//
+//MODE_CAPTURE - CCP1 latches timer1 in hardware
+//on every 1st, 4th or 16th rising edge on RC5
+//(CCP1, pin 5).  The CCP1IF isr only reads the
+//latched value, so there is no software latency
+//error.  Ranges 6-9.  The capture prescaler
+//restarts when the range changes, so the first
+//capture after a change only starts a new gate.
+//
+//MODE_DIRECT - for high frequencies, where the
+//reciprocal modes run out of resolution.  Timer0
+//counts T0CKI (RA2) edges and is never reloaded,
+//the T0IF isr extends it to 32 bits in software.
+//The gate is fixed, DIRECT_GATE_MS long, timed
+//by CCP1 compare on the free running timer1, and
+//the sample is the edge count over the gate.
+//Good up to the T0CKI limit, several mhz with the
+//prescaler.  Ranges 10-11.
+#define MODE_COUNTER        0
+#define MODE_CAPTURE        1
+#define MODE_DIRECT         2
+#define MEASURE_MODE        MODE_COUNTER
+
+__code const unsigned char gModeFirstRange[3] = {0, RANGE_CAPTURE, RANGE_DIRECT};
+__code const unsigned char gModeLastRange[3] = {RANGE_CAPTURE - 1, RANGE_DIRECT - 1, RANGE_MAX};
+__code const unsigned char gModeDefaultRange[3] = {RANGE_DEFAULT, RANGE_CAPTURE + 1, RANGE_DIRECT};
+
+unsigned char gMode = MEASURE_MODE;
+unsigned char gGateSkip = 0x00;         //isr - next capture / overflow only starts a gate
+
+volatile unsigned char gRange = RANGE_DEFAULT;          //isr - active
+volatile unsigned char gRangeRequest = RANGE_DEFAULT;   //main - wanted
+unsigned char gRangeReload = 0xF6;                      //isr - TMR0 load
+
+////////////////////////////////////////////////
+//Run time settings
+//What used to need a rebuild - measurement mode,
+//the range (trigger and prescales, or auto), the
+//counter trigger, the ClockTune value and the
+//report interval - is in gConfig.  Commands edit
+//gConfigNext, apply checks it and puts it in
+//effect in one go (Config_apply):  interrupts
+//off, the gate restarted and queued samples of
+//the old settings dropped, so no gate or reading
+//mixes the two.
+//
+//mode      MODE_xxx, starts MEASURE_MODE
+//range     RANGE_AUTO (USE_AUTORANGE), or a range
+//          of the mode - its trigger, timer0 and
+//          timer1 prescale from gRangeTable
+//trigger   counter mode with a fixed range only,
+//          timer0 edges per gate instead of the
+//          range's, same prescales.  Fewer is
+//          faster updates, more is finer.  0 -
+//          the range's own
+//tune      OSCTUNE, 0-15 faster, 31-16 slower.  It
+//          moves the baud rate the same amount,
+//          keep it small
+//rate      ms between readings, the report task,
+//          or the sleep with USE_SLEEP, in whole
+//          wdt periods, 33ms to 255 of them
+#define RANGE_AUTO          0xFF
+#define CONFIG_TUNE         3       //125, 250, 500, 1000hz on RC3
+#define CONFIG_RATE         1000
+#define TUNE_MAX            31
+#define RATE_MIN            10      //USE_SLEEP sets its own
+#define RATE_MAX            60000
+
+typedef struct
+{
+    unsigned char mode;
+    unsigned char range;        //RANGE_AUTO or fixed
+    unsigned char trigger;      //0 - from the range
+    unsigned char tune;
+    unsigned int rate;          //ms
+} Config;
+
+Config gConfig;                 //in effect, isr reads trigger
+Config gConfigNext;             //commands
+unsigned long gConfigFactor;    //trigger set - factor to use
 
-#define PRESCALE           PRESCALE_8
+void Config_init(void);
+unsigned char Config_apply(void);
 
-#define FREQUENCY_FACTOR      (2 * COUNTER_TRIGGER * PRESCALE)
+
+////////////////////////////////////////////////
+//Low power - measure, report, sleep
+//Timer0 (synced to the core), timer1, CCP1 and the
+//EUSART all run from fosc, so nothing is measured
+//or sent in sleep.  Instead of spinning, the main
+//loop restarts the gate, waits for one settled
+//reading, reports it, lets the transmitter drain
+//and sleeps POWER_SLEEP_PERIODS watchdog periods.
+//The wdt is the software one (SWDTEN, the config
+//word leaves it off) and only runs over sleep.
+//
+//Wakes early on:
+//EUSART RX - WUE, the start bit of any byte wakes
+//the part and reports right away.  The byte itself
+//is lost, it reads as 0x00.
+//RA2 change (IOC) - only after a no signal reading,
+//so a signal that comes back is seen at once.
+//
+//Timer1 can't be a wake source here, it is the
+//measurement timebase on fosc/4, and there is no
+//T1OSC crystal.  The wdt stands in for it.
+//
+//Off by default.  While asleep RC3 does not
+//toggle, so the RC3 - RA2 loopback reads no
+//signal, and a command line is only read on a
+//wake up (its first byte is the one lost).
+//
+//With no signal a reading takes the whole timer1
+//timeout awake.  IOC is armed over the sleep, so
+//if RA2 never moved there is still no signal and
+//the next reading is 0 without opening a gate.
+//
+//gPowerAwakeMs counts timer2 periods in the isr,
+//timer2 stops in sleep.  gPowerAsleepMs adds
+//POWER_PERIOD_MS per full wdt period, nominal, the
+//31khz lfintosc is not trimmed.  An early wake
+//loses the part period, under 33ms.
+//#define USE_SLEEP           1
+#define POWER_WDTPS         0x05        //1:1024, 33ms
+#define POWER_PERIOD_MS     33
+#define POWER_SLEEP_PERIODS 30          //about 1s between readings
+#define POWER_REPORT_EVERY  10          //readings per awake/asleep line
+
+#ifdef USE_SLEEP
+#undef RATE_MIN
+#undef RATE_MAX
+#define RATE_MIN            POWER_PERIOD_MS             //1 wdt period
+#define RATE_MAX            (0xFF * POWER_PERIOD_MS)    //8415, 255 of them
+
+volatile unsigned long gPowerAwakeMs = 0x00;    //isr
+unsigned long gPowerAsleepMs = 0x00;
+unsigned char gPowerReports = 0x00;
+unsigned char gPowerSleepPeriods = POWER_SLEEP_PERIODS;     //command rate
+unsigned char gPowerQuiet = 0x00;               //no signal, RA2 still
+#endif
 
 
 ///////////////////////////////////////////////////
@@ -84,7 +379,6 @@ freq(scope)     tim1        freq(computed)
 
 
 
-
 using prescale = 8, counter = 1 ans looking
 at lower frequencies.  added a check for
 tmr1if - overflow... it works.!!
@@ -113,18 +407,266 @@ using the tmr1if
 
 
 
-//////////////////////////////////////
-//prototypes
-volatile unsigned int gTimerTick = 0x00;
-unsigned int gCycleCounter = 0x00;
+////////////////////////////////////
+//ram budget - unverified
+//The part has 256 bytes of ram, 96 + 80 + 80 in
+//three banks, and SDCC keeps every local,
+//argument and temporary there too, there is no
+//stack.  The figures below are globals only,
+//read off a gcc build of the host program with
+//16 bit ints and packed structs.  No SDCC link
+//has been done, so they leave out the locals and
+//temporaries (static under SDCC, overlaid where
+//it can), the bank split and whatever the
+//libraries bring.  Flash, 4k words, is not
+//checked at all.  Whether a build fits is only
+//known from the .map of an SDCC link.
+//
+//  default, text output            224
+//  USE_SLEEP                       +11
+//  FILTER_MODE other than NONE     +27, median
+//                                  +20 locals
+//  OUTPUT_STREAM                   +36
+//  USE_TRACE                       +51
+//  USE_SCHED_STATS off             -24
+//
+//146 of the 224 are the shared code in ../common,
+//the usart rings and buffers, gTaskState and
+//gTimers.  main_withrx.c is 232 the same way, 56
+//of them gIrqStats.
+//
+//So the default would leave about 32 bytes for
+//the locals.  OUTPUT_STREAM and USE_TRACE would
+//only fit with USE_SCHED_STATS off and the
+//filter at FILTER_NONE, and not both at once.
+
+
+////////////////////////////////////
+//task scheduler and software timers, see
+//../common/sched.h
+//
+//The sleep path (USE_SLEEP, not streaming) does
+//its one reading per wake up without these.
+//
+//USE_SCHED_STATS keeps runs / late / worst for
+//the stats command, 8 bytes of ram a task.  Off
+//for OUTPUT_STREAM, see the ram budget.
+#define USE_SCHED_STATS     1
+#define TASK_COUNT          3
+#define TIMER_COUNT         2
+#define TIMER_SERIAL        0       //usart timeouts, polled
+#define TIMER_LED           1       //status led pattern
+
+#include "../common/sched.h"
+
+void Task_signal(void);
+void Task_measure(void);
+void Task_report(void);
+
+#define TASK_REPORT         2       //gTaskTable index
+
+__code const Task gTaskTable[TASK_COUNT] = {
+    {Task_signal,   10,     1},     //RC3 test signal, 50hz
+    {Task_measure,  5,      5},     //drain the sample queue
+    {Task_report,   1000,   100}    //one reading a second
+};
+
+void Led_step(void);
+
+__code const TimerCallback gTimerCallback[TIMER_COUNT] = {
+    0,                          //TIMER_SERIAL
+    Led_step                    //TIMER_LED
+};
+
+//status led, one bit of the pattern every
+//LED_STEP_MS, lsb first
+#define LED_STEP_MS         125
+#define LED_SIGNAL          0x01        //short flash a second
+#define LED_NO_SIGNAL       0x55        //4hz blink
+unsigned char gLedStep = 0x00;
+
+//Atomic_begin etc see ../common/sched.h, this
+//one is only used here
+void Atomic_writeInt(volatile unsigned int* value, unsigned int set);
+
+////////////////////////////////////
+//usart output format
+//OUTPUT_TEXT - "Freq: 1234.5hz\r\n", about 16 bytes
+//and a digit loop per reading.
+//OUTPUT_BINARY - one fixed 8 byte frame, nothing
+//formatted on the target:
+//
+//byte  0     FRAME_SYNC 0xA5
+//      1     sequence, +1 every frame, dropped
+//            frames still count so gaps show
+//      2     bits 0-3 range, 4-5 decimals,
+//            6 FRAME_RAW, 7 FRAME_NO_SIGNAL
+//      3-6   value, 32 bit little endian, hz
+//            * 10^decimals, or timer1 ticks
+//            when FRAME_RAW is set
+//      7     crc-8, poly 0x07, init 0x00, over
+//            bytes 0-6
+//
+//A frame only goes in the tx ring whole, if
+//there is no room it is dropped and counted in
+//gFrameDropped.  See tools/frame_decode.py.
+//
+//OUTPUT_STREAM - every gate the isr closes goes
+//out, not just one reading a second, for jitter
+//analysis.  12 byte frame:
+//
+//byte  0     STREAM_SYNC 0xA6
+//      1     sequence, +1 every sample, samples
+//            dropped on the isr queue or the tx
+//            ring still count so gaps show
+//      2-6   same as the 8 byte frame
+//      7-10  gate close time, 32 bit little
+//            endian, instruction cycles (fosc/4)
+//            since timer1 started, wraps
+//      11    crc-8 over bytes 0-10
+//
+//The isr stamps each sample with the 32 bit
+//timer1 count at gate close (the CCP1 latch in
+//capture mode), the main loop turns the timer1
+//steps into cycles with the prescale of the
+//range the gate ran at.  Drops are counted in
+//gSampleDropped (isr queue full) and
+//gStreamDropped (tx ring full).  At 57600 baud a
+//frame takes about 2ms, so the link keeps up to
+//about 450 samples/s.  Never sleeps, USE_SLEEP
+//is skipped in this mode.
+#define OUTPUT_TEXT         0
+#define OUTPUT_BINARY       1
+#define OUTPUT_STREAM       2
+#define OUTPUT_MODE         OUTPUT_TEXT
+
+#define FRAME_SIZE          8
+#define FRAME_SYNC          0xA5
+#define FRAME_RAW           0x40
+#define FRAME_NO_SIGNAL     0x80
+
+#define STREAM_FRAME_SIZE   12
+#define STREAM_SYNC         0xA6
+
+unsigned char gOutputMode = OUTPUT_MODE;
+unsigned char gFrameSeq = 0x00;
+unsigned int gFrameDropped = 0x00;
+
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+unsigned long gStreamStamp = 0x00;      //timer1 at the last sample
+unsigned long gStreamTime = 0x00;       //same, in cycles
+unsigned char gStreamLost = 0x00;       //Sample.dropped, last seen
+unsigned int gStreamDropped = 0x00;     //tx ring full
+#endif
+
+////////////////////////////////////
+//measurement queue - isr to main loop
+//Single producer (T0IF isr) / single consumer
+//(main loop) ring of raw gate samples.  The isr
+//only advances sampleHead, the main loop only
+//advances sampleTail, both are single bytes so
+//no locking is needed.  The isr does no math,
+//conversion to hz is done in Timer1_getFrequency.
+//If the ring is full the new sample is dropped
+//and counted in gSampleDropped.  The stamp and
+//dropped fields are for OUTPUT_STREAM only, the
+//ring is 5 bytes an entry smaller without.
+#define SAMPLE_QUEUE_SIZE   4       //power of 2
+#define SAMPLE_QUEUE_MASK   (SAMPLE_QUEUE_SIZE - 1)
+
+typedef struct
+{
+    unsigned int ticks;             //timer1 count at gate close
+    unsigned int overflows;         //timer1 overflows during gate
+    unsigned char range;            //range the gate ran with
+    unsigned char flags;            //SAMPLE_xxx
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+    unsigned long stamp;            //timer1 32 bit at gate close
+    unsigned char dropped;          //gSampleDropped low byte, at put
+#endif
+} Sample;
+
+#define SAMPLE_NO_SIGNAL    0x01    //gate timed out, no input
+
+Sample sampleQueue[SAMPLE_QUEUE_SIZE];
+volatile unsigned char sampleHead = 0x00;   //isr
+volatile unsigned char sampleTail = 0x00;   //main
+volatile unsigned int gSampleDropped = 0x00;
+Sample gSample;
+
+////////////////////////////////////
+//filter stage - main loop only
+//Every reading goes through the filter before
+//it is reported, so the update rate does not
+//change.  The ring holds the last FILTER_TAPS
+//readings in the fixed point of their range:
+//
+//FILTER_NONE - the reading as measured
+//FILTER_BOXCAR - mean of the last 4, sum >> 2
+//FILTER_EMA - y += (x - y) / 2^FILTER_EMA_SHIFT,
+//  kept as y << FILTER_EMA_SHIFT so the fraction
+//  is not lost.  About 2^shift readings to settle.
+//FILTER_MEDIAN3, FILTER_MEDIAN5 - middle of the
+//  last 3 or 5, a gate that caught an extra or
+//  missed edge is thrown out whole
+//
+//No divides, shifts and compares only.  Readings
+//in another range have another fixed point, so
+//the ring starts over at a range change, and
+//after no signal.  The stream (OUTPUT_STREAM)
+//stays raw.  gFilterMode can change at any time,
+//the ring and the ema run in every mode.  With
+//FILTER_MODE FILTER_NONE none of it is built,
+//it is over 40 bytes of ram with the median.
+#define FILTER_NONE         0
+#define FILTER_BOXCAR       1
+#define FILTER_EMA          2
+#define FILTER_MEDIAN3      3
+#define FILTER_MEDIAN5      4
+#define FILTER_MODE         FILTER_NONE
+
+#define FILTER_TAPS         5
+#define FILTER_BOXCAR_SHIFT 2       //4 taps
+#define FILTER_EMA_SHIFT    3       //1/8
+#define FILTER_EMPTY        0xFF    //gFilterRange - nothing in the ring
+
+#if (FILTER_MODE != FILTER_NONE)
+unsigned char gFilterMode = FILTER_MODE;
+unsigned long gFilterRing[FILTER_TAPS];
+unsigned char gFilterIndex = 0x00;              //next write
+unsigned char gFilterRange = FILTER_EMPTY;      //range of the ring
+unsigned long gFilterEma = 0x00;                //y << FILTER_EMA_SHIFT
+#endif
 
-volatile unsigned char gActiveFrequency = 1;
-volatile unsigned long gFrequency1 = 0x00;
-volatile unsigned long gFrequency2 = 0x00;
-volatile unsigned long gTimer1Value = 0x00;
+////////////////////////////////////
+//timer1 extended to 32 bits - the TMR1IF
+//isr counts overflows into the upper word.
+//If a gate runs for TIMER1_OVERFLOW_LIMIT
+//overflows without closing, the input is
+//taken as gone: a no signal sample is queued
+//and a new gate started.  In range 0 that is
+//about 10 seconds, so readings go down to
+//about 0.2hz.
+//
+//Timer1 is free running, it is never stopped
+//or reset.  Each gate is the difference between
+//the timestamp at its close and gGateStart, the
+//timestamp at the close of the gate before.
+#define TIMER1_OVERFLOW_LIMIT   40
+volatile unsigned int gTimer1Overflow = 0x00;
+unsigned long gGateStart = 0x00;            //isr only
+
+////////////////////////////////////
+//timer0 extended to 32 bits, MODE_DIRECT only.
+//The T0IF isr counts overflows, TMR0 holds the
+//low byte.  gGatePeriods counts down the CCP1
+//compare periods left in the gate, gGateMatch
+//is the timer1 value of the next one.
+volatile unsigned long gTimer0Overflow = 0x00;
+unsigned char gGatePeriods = DIRECT_GATE_PERIODS;
+unsigned int gGateMatch = 0x00;             //CCPR1 compare value
 
 
-void Delay(unsigned long val);
 void GPIO_init(void);
 void Timer0_init(void);
 void ClockConfig(unsigned long hz);
@@ -137,20 +679,220 @@ void Timer1_reset(void);
 void Timer1_setValue(unsigned int value);
 
 unsigned int Timer1_getValue(void);
+unsigned long Timer1_getValue32(void);
+unsigned long Timer1_extend(unsigned int low);
+unsigned long Timer0_getCount(void);
 unsigned long Timer1_getFrequency(void);
 unsigned long gFreq;
+unsigned char gFreqRange = RANGE_DEFAULT;
+
+void Sample_put(unsigned long ticks, unsigned long stamp, unsigned char flags);
+void Gate_close(unsigned long now, unsigned char flags);
+unsigned int Gate_flush(void);
+void Gate_restart(void);
+unsigned char Sample_get(Sample* sample);
+unsigned long Sample_getTicks(Sample* sample);
+unsigned long Sample_toFrequency(Sample* sample);
+
+void Range_apply(unsigned char range);
+void Range_update(Sample* sample);
+void Range_check(void);
+#if (FILTER_MODE != FILTER_NONE)
+void Filter_reset(unsigned long value, unsigned char range);
+unsigned long Filter_put(Sample* sample, unsigned long value);
+unsigned long Filter_median(unsigned char taps);
+#else
+#define Filter_put(sample, value)   (value)
+#endif
+unsigned char Frequency_format(unsigned long val, unsigned char decimals, char* buffer);
+
+#define REPORT_TEXT_MAX     21      //"Freq: 1234567890.hz\r\n"
+void Frequency_report(unsigned long freq);
+
+#ifdef USE_SLEEP
+void Power_init(void);
+unsigned long Power_measure(void);
+void Power_sleep(void);
+void Power_report(void);
+void Power_txWait(void);
+#endif
+
+//define to print old vs new dec2Buff cycle
+//counts over the usart at startup
+//#define DEC2BUFF_BENCH     1
+#ifdef DEC2BUFF_BENCH
+unsigned char dec2BuffDiv(unsigned long val, char* buffer);
+void Dec2Buff_bench(void);
+#endif
+unsigned char Frame_queue(unsigned char* frame, unsigned char size);
+void Frame_send(unsigned long value, unsigned char info);
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+void Stream_send(unsigned long value, unsigned char info, unsigned long stamp);
+void Stream_service(void);
+#endif
+
+
+////////////////////////////////////
+//usart rings and command interpreter, see
+//../common/usart.h
+//
+//With USE_SLEEP the byte that wakes the part is
+//lost, lead a command with a '\n'.
+#define OUT_BUFFER_SIZE     16      //"1234567890.", trace half lines
+#define TX_BUFFER_SIZE      32
+#define RX_BUFFER_SIZE      12      //longest command, rate 65535
 
-unsigned char dec2Buff(unsigned long val, char* buffer);
-void USART_init(void);
-void USART_Write(char* buffer, unsigned char length);
-void USART_WriteString(const char* buffer);
+#include "../common/usart.h"
+
+////////////////////////////////////
+//commands, see ../common/usart.h
+//
+//  d           trace dump, see Trace_dump
+//  sample      the latest reading, now
+//  stats       task and drop counters
+//
+//Settings, see gConfig.  These only change
+//gConfigNext, apply puts them in effect:
+//  mode n      MODE_xxx
+//  range [n]   hold range n, no n - auto range
+//  trig n      counter edges per gate, 0 - the
+//              range's own
+//  tune n      OSCTUNE, 0 - 31
+//  rate n      ms between readings, 10 - 60000
+//  apply       check and put in effect, ? and
+//              nothing changes if they don't fit
+//              together
+//  cfg         the settings in effect
+#define CMD_TRACE           0
+#define CMD_RANGE           1
+#define CMD_SAMPLE          2
+#define CMD_RATE            3
+#define CMD_STATS           4
+#define CMD_MODE            5
+#define CMD_TRIGGER         6
+#define CMD_TUNE            7
+#define CMD_APPLY           8
+#define CMD_CONFIG          9
+#define CMD_COUNT           10
+
+unsigned char Cmd_trace(void);
+unsigned char Cmd_range(void);
+unsigned char Cmd_sample(void);
+unsigned char Cmd_rate(void);
+unsigned char Cmd_stats(void);
+unsigned char Cmd_mode(void);
+unsigned char Cmd_trigger(void);
+unsigned char Cmd_tune(void);
+unsigned char Cmd_apply(void);
+unsigned char Cmd_config(void);
+
+__code const Command gCommandTable[CMD_COUNT] = {
+    {"d",       Cmd_trace,  CMD_ARG_NONE},
+    {"range",   Cmd_range,  CMD_ARG_NONE | CMD_ARG_VALUE},
+    {"sample",  Cmd_sample, CMD_ARG_NONE},
+    {"rate",    Cmd_rate,   CMD_ARG_VALUE},
+    {"stats",   Cmd_stats,  CMD_ARG_NONE},
+    {"mode",    Cmd_mode,   CMD_ARG_VALUE},
+    {"trig",    Cmd_trigger, CMD_ARG_VALUE},
+    {"tune",    Cmd_tune,   CMD_ARG_VALUE},
+    {"apply",   Cmd_apply,  CMD_ARG_NONE},
+    {"cfg",     Cmd_config, CMD_ARG_NONE}
+};
+
+//by Command_hash
+__code const unsigned char gCommandSlot[CMD_HASH_MASK + 1] = {
+    CMD_NONE,    CMD_RATE,    CMD_RANGE,   CMD_NONE,
+    CMD_SAMPLE,  CMD_NONE,    CMD_NONE,    CMD_NONE,
+    CMD_APPLY,   CMD_NONE,    CMD_MODE,    CMD_NONE,
+    CMD_NONE,    CMD_TRACE,   CMD_NONE,    CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_STATS,   CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_NONE,    CMD_TUNE,
+    CMD_TRIGGER, CMD_NONE,    CMD_CONFIG,  CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_NONE,    CMD_NONE
+};
 
 
 ////////////////////////////////////
-//usart output
-unsigned char n;
-#define OUT_BUFFER_SIZE     32
-char outbuffer[OUT_BUFFER_SIZE];
+//trace ring - what happened when, after the
+//fact, without a logic analyzer
+//TRACE(id) puts an event id and the 16 bit
+//timer1 count in the ring, oldest entry goes.
+//Inline, no call, so the isr and the main loop
+//can both use it - about 20 instructions.  It
+//needs interrupts off: the isr, or a section
+//already inside Atomic_begin / GIE = 0.  The
+//main loop uses TRACE_MAIN, same with GIE held
+//off around it.
+//
+//Timer1 ticks at the t1 prescale of the active
+//range (TRACE_RANGE entries show the changes),
+//so a gap in ticks is a gap in time.  The order
+//of T0_CLOSE and T1_OVERFLOW entries shows
+//which gate an overflow went to - the 6.3hz
+//reads 32 case in the notes below.
+//
+//Command 'd' dumps it, oldest first, see
+//Trace_dump.  TRACE_SIZE * 3 + 3 bytes of ram,
+//more than the part can spare with everything
+//else in, so it is off by default.  See the ram
+//budget before defining USE_TRACE.
+//#define USE_TRACE           1
+#define TRACE_SIZE          16      //power of 2
+#define TRACE_MASK          (TRACE_SIZE - 1)
+
+#define TRACE_EMPTY         0x00
+//isr
+#define TRACE_T0_OPEN       0x01    //first overflow, opens the gate
+#define TRACE_T0_CLOSE      0x02    //overflow, gate closed
+#define TRACE_T1_OVERFLOW   0x03
+#define TRACE_TIMEOUT       0x04    //gate timed out, no signal
+#define TRACE_CCP1_OPEN     0x05
+#define TRACE_CCP1_CLOSE    0x06
+#define TRACE_DIRECT        0x07    //direct count gate closed
+#define TRACE_DROP          0x08    //sample queue full
+#define TRACE_RANGE         0x10    //+ range, range applied
+//main loop
+#define TRACE_SAMPLE        0x20    //sample off the queue
+#define TRACE_REPORT        0x21
+#define TRACE_RESTART       0x22    //Gate_restart
+#define TRACE_SLEEP         0x23
+#define TRACE_WAKE          0x24
+
+#ifdef USE_TRACE
+unsigned char gTraceEvent[TRACE_SIZE];
+unsigned int gTraceTime[TRACE_SIZE];
+unsigned char gTraceHead = 0x00;        //next entry, oldest when full
+unsigned char gTraceOn = 1;             //off over a dump
+unsigned char gTraceHigh;               //TRACE scratch, TMR1H
+
+//timer1 high, low, high - read again if TMR1L
+//rolled over in between
+#define TRACE(id)                                                       \
+    do {                                                                \
+        if (gTraceOn)                                                   \
+        {                                                               \
+            gTraceEvent[gTraceHead] = (id);                             \
+            do {                                                        \
+                gTraceHigh = TMR1H;                                     \
+                gTraceTime[gTraceHead] = TMR1L + ((unsigned int)gTraceHigh << 8); \
+            } while (gTraceHigh != TMR1H);                              \
+            gTraceHead = (gTraceHead + 1) & TRACE_MASK;                 \
+        }                                                               \
+    } while (0)
+
+#define TRACE_MAIN(id)                                                  \
+    do {                                                                \
+        unsigned char gie = GIE;                                        \
+        do { GIE = 0; } while (GIE);                                    \
+        TRACE(id);                                                      \
+        GIE = gie;                                                      \
+    } while (0)
+
+void Trace_dump(void);
+#else
+#define TRACE(id)
+#define TRACE_MAIN(id)
+#endif
 
 
 ////////////////////////////////////////
@@ -161,89 +903,220 @@ char outbuffer[OUT_BUFFER_SIZE];
 //
 //whne configured as counter, it triggers
 //on overflow.  
-static void irqHandler(void) __interrupt 0
+HAL_INTERRUPT(irqHandler)
 {          
     //interrupt soucre = timer0
-    if (T0IF == 1)
+    //T0IF sets on every overflow, T0IE is off
+    //in capture mode so check both
+    if ((T0IE == 1) && (T0IF == 1))
     {
 
 #ifdef USE_COUNTER
         
-        //compute input frequency on RA2  
-        gTimer1Value = Timer1_getValue() & 0xFFFF;
+        //direct count - timer0 just wrapped, the
+        //gate is timed by CCP1 instead
+        if (gMode == MODE_DIRECT)
+            gTimer0Overflow++;
+        else
+        {
+            //timestamp the gate and queue the raw
+            //timer1 count, main loop converts it to hz.
+            //After a restart the first overflow is the
+            //first edge, it only opens the gate.
+            if (gGateSkip)
+            {
+                gGateStart = Timer1_getValue32();
+                TMR0 += gRangeReload;
+                gGateSkip = 0x00;
+                TRACE(TRACE_T0_OPEN);
+            }
+            else
+            {
+                Gate_close(Timer1_getValue32(), 0x00);
+                TRACE(TRACE_T0_CLOSE);
+            }
+
+            //flash debug led to indicate polling rate
+            PORTC ^= (1u << 1);     //toggle RC1
+        }
+#endif
+        T0IF = 0;       //clear the counter flag
+    }
 
-        //check timer1 overflow flag
-        if (TMR1IF == 1)
-            gTimer1Value += 0xFFFF;
+#ifdef USE_COUNTER
+    ////////////////////////////////////////
+    //CCP1 capture - timer1 latched in hardware
+    //on the input edge, CCPR1 holds the low word.
+    //Ahead of the TMR1IF branch: a capture just
+    //before the wrap can come in with TMR1IF set
+    //too, Timer1_extend only gets that right while
+    //the overflow is not counted yet.
+    //
+    //CCP1 compare in MODE_DIRECT - timer1 matched
+    //CCPR1, move the match on by one period, high
+    //byte first so the half written value is never
+    //close to timer1.  The latency to the TMR0 read
+    //is about the same every gate, so it cancels.
+    if ((CCP1IE == 1) && (CCP1IF == 1) && (gMode == MODE_DIRECT))
+    {
+        CCP1IF = 0;
 
-        if (!gTimer1Value)      //avoid / 0
-            gTimer1Value = 1;
+        gGatePeriods--;
+        if (!gGatePeriods)
+        {
+            gGatePeriods = DIRECT_GATE_PERIODS;
+#ifdef USE_PRESCALER_FLUSH
+            gGateMatch += Gate_flush();     //input was held off
+#else
+            Gate_close(Timer0_getCount(), 0x00);
+#endif
+            TRACE(TRACE_DIRECT);
+            PORTC ^= (1u << 1);     //toggle RC1
+        }
 
-        //FREQUENCY_FACTOR accounts for num cycles and
-        //timer1 prescaler.
-        if (gActiveFrequency == 1)
+        gGateMatch += DIRECT_GATE_TICKS;
+        CCPR1H = (unsigned char)(gGateMatch >> 8);
+        CCPR1L = (unsigned char)gGateMatch;
+    }
+    else if ((CCP1IE == 1) && (CCP1IF == 1))
+    {
+        if (gGateSkip)
         {
-            gFrequency2 = FREQUENCY_FACTOR / gTimer1Value;     //prescale2
-            gActiveFrequency = 2;
+            //prescaler just restarted - this edge
+            //only opens the next gate
+            gGateStart = Timer1_extend(CCPR1L + ((unsigned int)CCPR1H << 8));
+            gGateSkip = 0x00;
+            TRACE(TRACE_CCP1_OPEN);
         }
         else
         {
-            gFrequency1 = FREQUENCY_FACTOR / gTimer1Value;     //prescale2
-            gActiveFrequency = 1;
+            Gate_close(Timer1_extend(CCPR1L + ((unsigned int)CCPR1H << 8)), 0x00);
+            TRACE(TRACE_CCP1_CLOSE);
         }
-        
-        //flash debug led to indicate polling rate
-        //init counter value to roll over at specified rate
+
         PORTC ^= (1u << 1);     //toggle RC1
-        TMR0 = COUNTER_RESET;   //load the initial count value
+        CCP1IF = 0;
+    }
+#endif
 
-        //reset timer and clear overflow flag
-        Timer1_reset();
+    ////////////////////////////////////////
+    //timer1 overflow - extend to 32 bits
+    if (TMR1IF == 1)
+    {
+        gTimer1Overflow++;
+        TMR1IF = 0;
+        TRACE(TRACE_T1_OVERFLOW);
 
-#else
-        gTimerTick++;
+#ifdef USE_COUNTER
+        //gate has been open too long - no input.
+        //report it and start over.  direct count
+        //gates are fixed, zero edges is a reading.
+        if ((gMode != MODE_DIRECT) && (gTimer1Overflow - (unsigned int)(gGateStart >> 16)) >= TIMER1_OVERFLOW_LIMIT)
+        {
+            TMR0 = 0xFF;            //drop the partial count, open on the next
+            T0IF = 0;
+            Gate_close(Timer1_getValue32(), SAMPLE_NO_SIGNAL);
+            gGateSkip = 1;          //next capture / overflow starts the gate
+            TRACE(TRACE_TIMEOUT);
+        }
 #endif
-        T0IF = 0;       //clear the counter flag
     }
 
+    ////////////////////////////////////////
+    //usart, see USART_rxIsr / USART_txIsr.  TXIF
+    //stays set while TXREG is empty, so only
+    //while TXIE is on.
+    if ((RCIE == 1) && (RCIF == 1))
+        USART_rxIsr();
 
-   
+    if ((TXIE == 1) && (TXIF == 1))
+        USART_txIsr();
+
+    ////////////////////////////////////////
+    //timer2 - 1ms, scheduler tick, awake time
+    if ((TMR2IE == 1) && (TMR2IF == 1))
+    {
+        TMR2IF = 0;
+        gSchedPending++;
+        Timer_tick();
+#ifdef USE_SLEEP
+        gPowerAwakeMs++;
+#endif
+    }
 }
 
 
 /////////////////////////////////////
 int main()
 {
-    ClockConfig(8000000);   //125, 250hz, 500, 1000hz
+    ClockConfig(SYSTEM_CLOCK);  //125, 250hz, 500, 1000hz
     GPIO_init();
     Timer0_init();
+    Timer2_init();
+    Timer_init();
     Timer1_init();
     USART_init();
 
-    while (1)
-    {
-        //status led
-        PORTC ^= (1 << 0);
+#ifdef USE_AUTOBAUD
+    USART_autoBaudStart(AUTOBAUD_WAIT_MS);
+#endif
+
+#ifdef USE_SLEEP
+    Power_init();
+#endif
 
-        //toggle RC3 and connect to RA2
-        //RA2 is the input pin to counter.
-        //RC3 is connected to pin 7
-        //RA2 is pin 17
-        PORTC ^= (1 << 3);
+#ifdef DEC2BUFF_BENCH
+    Dec2Buff_bench();
+#endif
 
-        //output the value over usart every 100 cycles
-        if (!(gCycleCounter % 100))
-        {
-            USART_WriteString("Freq: ");
-            gFreq = Timer1_getFrequency();
-            n = dec2Buff(gFreq, outbuffer);
+    Sched_init();
+    Config_init();
+    Config_apply();             //after Sched_init, sets the report period
+    Timer_start(TIMER_LED, LED_STEP_MS, LED_STEP_MS);
+    gSample.flags = SAMPLE_NO_SIGNAL;   //no reading yet
 
-            USART_Write(outbuffer, n);
-            USART_WriteString("hz\r\n");
+    while (1)
+    {
+#ifdef USE_SLEEP
+        //streaming stays awake, see OUTPUT_STREAM,
+        //and so does auto-baud
+        if ((gOutputMode != OUTPUT_STREAM) && (gAutoBaud.state == AUTOBAUD_IDLE))
+        {
+            //status led
+            PORTC ^= (1 << 0);
+
+            //one settled reading per wake up
+            gFreq = Power_measure();
+            Frequency_report(gFreq);
+
+            //text only, frames carry readings alone
+            if (!gPowerReports)
+            {
+                gPowerReports = POWER_REPORT_EVERY;
+                if (gOutputMode == OUTPUT_TEXT)
+                    Power_report();
+            }
+            gPowerReports--;
+
+            //command lines that came in meanwhile
+            USART_ServiceRx();
+
+            Power_sleep();
         }
+        else
+#endif
+        {
+            //whatever is due, see gTaskTable and
+            //gTimerCallback
+            Sched_run();
+            Timer_service();
+
+            //parse any command lines posted by the isr
+            USART_ServiceRx();
+            USART_autoBaudPoll();
 
-        Delay(10);
-        gCycleCounter++;
+            HAL_POLL(20);
+        }
     }
 
     return 0;
@@ -252,21 +1125,55 @@ int main()
 
 
 //////////////////////////////////////////
-//Delay function.
-//When configured as counter, the delay function
-//is not that accurate.  When configured as timer
-//the delay function works well.
-void Delay(unsigned long val)
+//Tasks, run from Sched_run
+
+//toggle RC3 and connect to RA2
+//RA2 is the input pin to counter.
+//RC3 is connected to pin 7
+//RA2 is pin 17
+//with USE_PRESCALER_FLUSH go through a 1k
+//resistor, RA2 is driven at gate close
+void Task_signal(void)
 {
-#ifdef USE_COUNTER
-    volatile unsigned long temp = val * 96;
-    while (temp > 0)
-        temp--;
+    PORTC ^= (1 << 3);
+}
+
+
+//drain the measurement queue, streaming sends
+//every sample as it comes
+void Task_measure(void)
+{
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+    Stream_service();
 #else
-    gTimerTick = 0x00;
-    while(gTimerTick < val){};
+    Timer1_getFrequency();
 #endif
+}
+
+
+//output the value over usart
+void Task_report(void)
+{
+    if (gOutputMode != OUTPUT_STREAM)
+        Frequency_report(gFreq);
+}
+
+
+//TIMER_LED callback, next step of the status
+//led pattern
+void Led_step(void)
+{
+    unsigned char pattern = LED_SIGNAL;
 
+    if ((gSample.flags & SAMPLE_NO_SIGNAL))
+        pattern = LED_NO_SIGNAL;
+
+    if (pattern & (1u << gLedStep))
+        PORTC |= (1 << 0);
+    else
+        PORTC &=~ (1 << 0);
+
+    gLedStep = (gLedStep + 1) & 0x07;
 }
 
 
@@ -305,7 +1212,8 @@ void Timer0_init(void)
     //Registers of interest:
     //TMR0 - 8 bit reg - can write directly
 #ifdef USE_COUNTER
-    TMR0 = COUNTER_RESET;   //load the initial count value
+    gRangeReload = gRangeTable[RANGE_DEFAULT].reload;
+    TMR0 = gRangeReload;    //load the initial count value
 #else
     TMR0 = 0x00;        //clear the timer
 #endif
@@ -331,7 +1239,7 @@ void Timer0_init(void)
     OPTION_REG &=~ 0x07;            //clear bits 0-2
 
 #ifdef USE_COUNTER
-    OPTION_REG |= 0x00;            //prescale 2 for counter
+    OPTION_REG |= gRangeTable[RANGE_DEFAULT].t0ps;  //prescale for counter
 #else
     OPTION_REG |= 0x02;            //prescale 8 = about 980hz
 #endif
@@ -345,6 +1253,7 @@ void Timer0_init(void)
 }
 
 
+
 /////////////////////////////////////
 //Configure the internal oscillator 
 //speed in hz.  For now, use, 1, 2, 4, 8mhz
@@ -377,7 +1286,8 @@ void ClockConfig(unsigned long hz)
 
     //minor adjustments in clock speed
     //falls on 125, 250, 500, 1000 hz
-    ClockTune(3);
+    //gConfig.tune from here on, see Config_apply
+    ClockTune(CONFIG_TUNE);
 }
 
 
@@ -413,17 +1323,21 @@ void Timer1_init(void)
     T1CON &=~ (1u << 7);    //timer1 gate active low - NA
     T1CON &=~ (1u << 6);    //timer1 is on regardless of gate
 
-  //  T1CON &=~ (1u << 5);    //prescale 01 - 1:2
-  //  T1CON |= (1u << 4);     //prescale 01 - 1:2
-
-    T1CON |= (1u << 5);    //prescale 11 - 1:8
-    T1CON |= (1u << 4);     //prescale 11 - 1:8
+    //prescale bits 5-4 from the starting range
+    //00 - 1:1, 01 - 1:2, 10 - 1:4, 11 - 1:8
+    T1CON &=~ 0x30;
+    T1CON |= gRangeTable[RANGE_DEFAULT].t1ps;
 
     T1CON &=~ (1u << 3);    //LP is off
     T1CON |= (1u << 2);     //no sync ext clock - ok
     T1CON &=~ (1u << 1);    //internal clock - fosc/4
 
     TMR1IF = 0x00;          //timer1 overflow flag
+    gTimer1Overflow = 0x00;
+
+    //overflow interrupt extends the count to 32 bits
+    TMR1IE = 1;             //PIE1 register
+    PEIE = 1;               //INTCON register
 
     T1CON |= (1u << 0);     //timer1 is on
 
@@ -446,13 +1360,15 @@ void Timer1_stop(void)
 
 ///////////////////////////////
 //reset timer value - 16 bit in
-//registers TMR1H and TMR1L
+//registers TMR1H and TMR1L plus the
+//software overflow count
 void Timer1_reset(void)
 {
     T1CON &=~ 0x01;    //disable
     TMR1L = 0x00;
     TMR1H = 0x00;    
     TMR1IF = 0x00;    //clear ov flag
+    Atomic_writeInt(&gTimer1Overflow, 0x00);
     T1CON |= 0x01;    //enable
 }
 
@@ -466,154 +1382,1361 @@ void Timer1_setValue(unsigned int value)
     TMR1L = value & 0xFF;       //low byte
     TMR1H = (value >> 8) & 0xFF;//high byte
     TMR1IF = 0x00;              //clear ov flag
+    Atomic_writeInt(&gTimer1Overflow, 0x00);
     T1CON |= 0x01;              //enable
 }
 
 
 //////////////////////////////////
 //Return current 16bit timer1 value
+//Read on the fly, timer keeps running.
+//high, low, high - if TMR1L rolled into
+//TMR1H between the reads, read again.
 unsigned int Timer1_getValue(void)
 {
-    unsigned int valuel, valueh;
+    unsigned char valuel, valueh;
 
-    T1CON &=~ 0x01;    //disable
-    valuel = TMR1L;
-    valueh = TMR1H;
-    T1CON |= 0x01;    //enable
+    do
+    {
+        valueh = TMR1H;
+        valuel = TMR1L;
+    } while (valueh != TMR1H);
 
-    return ((valuel & 0xFF) + ((valueh & 0xFF) << 8));
+    return (valuel + ((unsigned int)valueh << 8));
 }
 
 
-unsigned long Timer1_getFrequency(void)
+//////////////////////////////////
+//Return the 32 bit timer1 value, overflow
+//count in the upper word.  Call with interrupts
+//off (from the isr or with GIE = 0).
+//
+//An overflow can happen after the isr was
+//entered but before TMR1H/TMR1L are read, so
+//TMR1IF may be pending and not counted yet.  If
+//it is, it belongs to this reading only when
+//the low word has already wrapped (msb clear),
+//otherwise the overflow came after the read.
+unsigned long Timer1_getValue32(void)
 {
-    if (gActiveFrequency == 1)
-        return gFrequency1;
-    else
-        return gFrequency2;
+    return Timer1_extend(Timer1_getValue());
 }
 
 
+//////////////////////////////////
+//Extend a 16 bit timer1 value read now, or
+//latched by CCP1 a short time ago, with the
+//software overflow count.  Same rules as
+//Timer1_getValue32, interrupts off.
+unsigned long Timer1_extend(unsigned int low)
+{
+    unsigned int high;
 
+    high = gTimer1Overflow;
 
-////////////////////////////////////////////////
-//set up the serial transimitter - much of this is from
-//section 12.1 of the user manual
-	
-//setup the baud rate - use SPBRGH, SPBRG, BRGH, and BRG16 bits
-//see section 12.3
-//See Table 12-5.  For 8 mhz clock, 8 bit async, SYNC = 0
-//BRGH = 1, and BRG16 = 0, 9600 baud, SPBRG = 51
+    if ((TMR1IF == 1) && !(low & 0x8000))
+        high++;
 
-void USART_init(void)
+    return ((unsigned long)high << 16) + low;
+}
+
+
+//////////////////////////////////
+//Read the 32 bit timer0 count, isr only (or
+//with GIE off).  Same fix up as Timer1_extend,
+//if T0IF is pending and TMR0 has already
+//wrapped, the overflow is not counted yet.
+unsigned long Timer0_getCount(void)
 {
-    //baud rate
-	SPBRGH = 51;
-	SPBRG = 51;
+    unsigned char low;
+    unsigned long high;
 
-	//8 bit async mode - see table 12-3
-	SYNC = 0;       //enable async opperation
-	BRGH = 1;
-	BRG16 = 0;
+    low = TMR0;
+    high = gTimer0Overflow;
 
-	//enable the serial port - clear the SYNC bit and 
-	//set the SPEN bit.  Clearing the SYNC 
-	SYNC = 0;       //enable async opperation
-	SPEN = 1;       //auto config tx/rx pins as output/input
+    if ((T0IF == 1) && !(low & 0x80))
+        high++;
 
+    return (high << 8) + low;
 }
 
 
 
-//////////////////////////////////////////////
-//Serial Write
-//buffer and  a length
-//
-void USART_Write(char* buffer, unsigned char length)
+//////////////////////////////////
+//Write an int the isr reads in one piece
+void Atomic_writeInt(volatile unsigned int* value, unsigned int set)
 {
-    unsigned char i = 0;
+    unsigned char gie = Atomic_begin();
 
-	//clear the TXREG
-	TXREG = 0x00;
-	TXEN = 1;
+    *value = set;
+    Atomic_end(gie);
+}
 
-	for (i = 0 ; i < length ; i++)
-	{
-		TXEN = 1;
-		TXREG = buffer[i];
-		while (TRMT != 1)
-		{}
-	}
 
-	TXEN = 0;   //disable tx to avoid bad data
-}
+//////////////////////////////////
+//Convert everything the isr has queued and
+//return the most recent frequency in hz, kept
+//in gFreq.  Returns the previous reading if
+//nothing new has been measured.  Call from the
+//main loop often enough to keep the queue from
+//filling.
+unsigned long Timer1_getFrequency(void)
+{
+    while (Sample_get(&gSample))
+    {
+        gFreq = Filter_put(&gSample, Sample_toFrequency(&gSample));
+        gFreqRange = gSample.range;
 
+#ifdef USE_AUTORANGE
+        Range_update(&gSample);
+#endif
+    }
 
+#ifdef USE_AUTORANGE
+    Range_check();
+#endif
+    return gFreq;
+}
 
-///////////////////////////////////////////////
-//
-void USART_WriteString(const char* buffer)
+
+#if (FILTER_MODE != FILTER_NONE)
+//////////////////////////////////
+//Fill the filter ring with one reading, the
+//filter output is that reading right away.
+void Filter_reset(unsigned long value, unsigned char range)
 {
-    unsigned char i = 0;
+    unsigned char i;
+
+    for (i = 0 ; i < FILTER_TAPS ; i++)
+        gFilterRing[i] = value;
 
-	//clear the TXREG
-	TXREG = 0x00;
-	TXEN = 1;
+    gFilterIndex = 0x00;
+    gFilterRange = range;
+    gFilterEma = value << FILTER_EMA_SHIFT;
+}
+
+
+//////////////////////////////////
+//Add a reading (Sample_toFrequency of the
+//sample) and return the filtered value, in
+//the same fixed point.  No signal passes
+//through as 0 and empties the ring.
+unsigned long Filter_put(Sample* sample, unsigned long value)
+{
+    unsigned long sum;
+    unsigned char i, n;
 
-    while ((buffer[i] != 0x00) && (i < 64))
+    if (sample->flags & SAMPLE_NO_SIGNAL)
     {
-		TXEN = 1;
-		TXREG = buffer[i];
-		while (TRMT != 1)
-		{}
-        i++;
+        gFilterRange = FILTER_EMPTY;
+        return value;
     }
 
-	TXEN = 0;
-}
+    if (sample->range != gFilterRange)
+        Filter_reset(value, sample->range);
 
+    gFilterRing[gFilterIndex] = value;
+    gFilterIndex++;
+    if (gFilterIndex >= FILTER_TAPS)
+        gFilterIndex = 0x00;
 
+    //unsigned wrap makes the - side come out right
+    gFilterEma += value - (gFilterEma >> FILTER_EMA_SHIFT);
 
-///////////////////////////////////////////
-//convert unsigned long value into a char
-//buffer with return value of num chars to 
-//print.
-//For now, assume that is upto 10 000 000 - 8 chars
+    switch (gFilterMode)
+    {
+        case FILTER_BOXCAR:
+            sum = 0x00;
+            i = gFilterIndex;
+            for (n = 0 ; n < (1u << FILTER_BOXCAR_SHIFT) ; n++)
+            {
+                i = i ? (i - 1) : (FILTER_TAPS - 1);
+                sum += gFilterRing[i];
+            }
+            return sum >> FILTER_BOXCAR_SHIFT;
+
+        case FILTER_EMA:
+            return gFilterEma >> FILTER_EMA_SHIFT;
+
+        case FILTER_MEDIAN3:
+            return Filter_median(3);
+
+        case FILTER_MEDIAN5:
+            return Filter_median(5);
+    }
 
-//keep getting warnings about left operand too
-//short for reuslt regarding data in c or buffer
-//
-unsigned char dec2Buff(unsigned long val, char* buffer)
+    return value;
+}
+
+
+//////////////////////////////////
+//Median of the newest taps readings, taps odd
+//and up to FILTER_TAPS.  Insertion sort of a
+//copy, 10 compares at most for 5.
+unsigned long Filter_median(unsigned char taps)
 {
-    unsigned char i = 0;
-    char digit;
-    unsigned char num = 0;
-    char t;
+    unsigned long sorted[FILTER_TAPS];
+    unsigned long v;
+    unsigned char i, j, k;
 
-    while (val > 0)
+    k = gFilterIndex;
+    for (i = 0 ; i < taps ; i++)
     {
-        digit = (char)(val % 10);
-        buffer[num] = (0x30 + digit) & 0x7F;
-        num++;          
-        val = val / 10;
+        k = k ? (k - 1) : (FILTER_TAPS - 1);
+        v = gFilterRing[k];
+
+        for (j = i ; (j > 0) && (sorted[j - 1] > v) ; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
     }
 
-    //reverse in place
-    for (i = 0 ; i < num / 2 ; i++)
+    return sorted[taps >> 1];
+}
+#endif
+
+
+//////////////////////////////////
+//Push a sample onto the measurement queue,
+//isr only.  Tagged with the active range and
+//the timer1 time of the gate close.  Dropped
+//and counted if the queue is full.
+void Sample_put(unsigned long ticks, unsigned long stamp, unsigned char flags)
+{
+    unsigned char next;
+
+    next = (sampleHead + 1) & SAMPLE_QUEUE_MASK;
+    if (next == sampleTail)
     {
-        t = buffer[i];
-        buffer[i] = buffer[num - i - 1];
-        buffer[num - i - 1] = t;
-    }  
+        gSampleDropped++;
+        TRACE(TRACE_DROP);
+        return;
+    }
 
-    buffer[num] = 0x00;     //null terminated
-    
-    return num;
+    sampleQueue[sampleHead].ticks = (unsigned int)(ticks & 0xFFFF);
+    sampleQueue[sampleHead].overflows = (unsigned int)(ticks >> 16);
+    sampleQueue[sampleHead].range = gRange;
+    sampleQueue[sampleHead].flags = flags;
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+    sampleQueue[sampleHead].stamp = stamp;
+    sampleQueue[sampleHead].dropped = (unsigned char)gSampleDropped;
+#endif
+    sampleHead = next;
 }
 
 
+//////////////////////////////////
+//Close the current gate and open the next one,
+//isr only.  The gate length is the timer1
+//difference from the previous close, so there
+//is no stop/reset of timer1 and no lost ticks.
+//A pending range change is applied here, the
+//T1CON prescale bits change while timer1 runs
+//so at most one tick of the next gate is off.
+//
+//TMR0 already counted any edges that came in
+//since it overflowed, so the reload is added
+//instead of written over them.
+//
+//now is the 32 bit timer1 timestamp of the
+//gate close, read in the isr for MODE_COUNTER
+//or latched by CCP1 for MODE_CAPTURE.  In
+//MODE_DIRECT it is the timer0 count, the sample
+//is stamped with timer1 read here instead.
+void Gate_close(unsigned long now, unsigned char flags)
+{
+    Sample_put(now - gGateStart, (gMode == MODE_DIRECT) ? Timer1_getValue32() : now, flags);
+    gGateStart = now;
+
+    //range change requested by the main loop,
+    //switch now between gates
+    if (gRangeRequest != gRange)
+        Range_apply(gRangeRequest);
+
+    if (gMode == MODE_COUNTER)
+        TMR0 += gRangeReload;
+}
 
 
+//////////////////////////////////
+//Close a direct count gate with the timer0
+//prescaler flushed, isr only.
+//
+//RA2 is driven at the level it already has, so
+//the input is held off with no new edge.  Then
+//it is pulsed until the prescaler rolls over
+//into TMR0 (falling edge counts, T0SE = 1).
+//The edges that were sitting in the prescaler
+//are the prescale less the pulses it took, and
+//the prescaler is left empty for the next gate:
+//
+//  edges = (count - start) * prescale + residue
+//
+//The pulses are taken out by starting the next
+//gate at count + 1.  Returns the timer1 ticks RA2
+//was held for, the caller moves the next compare
+//out by the same so the input still sees a
+//DIRECT_GATE_MS gate.
+//
+//No waiting on a fixed window, the hold is the
+//pulses (at most the prescale, 16 in range 11)
+//and the Sample_put.  Estimated 300-400 cycles,
+//about 200us in the isr, not measured.  The
+//nops after each edge are what timer0 needs, the
+//falling edge goes through a 2 cycle sync before
+//TMR0 moves.
+unsigned int Gate_flush(void)
+{
+    unsigned int start;
+    unsigned long count;
+    unsigned int pulses = 0x00;
+    unsigned char low, shift;
+
+    if (gRangeTable[gRange].t0ps & 0x08)
+        shift = 0;                              //no prescale
+    else
+        shift = (gRangeTable[gRange].t0ps & 0x07) + 1;
+
+    if (PORTA & (1u << 2))
+        PORTA |= (1u << 2);
+    else
+        PORTA &=~ (1u << 2);
+    TRISA &=~ (1u << 2);            //RA2 output - input held off
+
+    start = Timer1_getValue();
+    count = Timer0_getCount();
+
+    low = TMR0;
+    do
+    {
+        PORTA |= (1u << 2);
+        HAL_NOP();
+        PORTA &=~ (1u << 2);
+        HAL_DELAY_CYCLES(3);
+        pulses++;
+    } while ((TMR0 == low) && (pulses < (1u << shift)));
+
+    Sample_put(((count - gGateStart) << shift) + (1u << shift) - pulses, Timer1_extend(start), 0x00);
+    gGateStart = count + 1;
+
+    if (gRangeRequest != gRange)
+        Range_apply(gRangeRequest);
+
+    start = Timer1_getValue() - start;
+    TRISA |= (1u << 2);             //RA2 input again
+
+    return start;
+}
+
+
+//////////////////////////////////
+//Set up timer0 or CCP1 for gMode and start a
+//fresh gate at gRangeRequest, main loop only.
+//Also how the measurement comes back after
+//sleep.  Timer1 keeps running in all modes.
+//In counter mode the first overflow only opens
+//the gate, the count up to it started mid
+//period.
+void Gate_restart(void)
+{
+    unsigned char mode = gMode;
+    unsigned char gie = Atomic_begin();
+
+    TRACE(TRACE_RESTART);
+    if (mode == MODE_CAPTURE)
+    {
+        T0IE = 0;
+        TRISC |= (1u << 5);     //RC5 - CCP1 input
+        CCP1IE = 1;
+    }
+    else
+    {
+        CCP1CON = 0x00;         //capture off
+        CCP1IE = 0;
+        TMR0 = 0x00;
+        T0IF = 0;
+        T0IE = 1;
+    }
+
+    //the next count opens the gate, a prescale
+    //worth of edges rather than a whole gate
+    Range_apply(gRangeRequest);
+    if (mode == MODE_COUNTER)
+    {
+        TMR0 = 0xFF;
+        gGateSkip = 1;
+    }
+    gGateStart = Timer1_getValue32();
+
+    //direct count - timer0 counts from 0, CCP1
+    //compare (software interrupt only) times
+    //the gate from now
+    if (mode == MODE_DIRECT)
+    {
+        TMR0 = 0x00;
+        gTimer0Overflow = 0x00;
+        gGateStart = 0x00;
+        gGatePeriods = DIRECT_GATE_PERIODS;
+        gGateMatch = Timer1_getValue() + DIRECT_GATE_TICKS;
+        CCPR1H = (unsigned char)(gGateMatch >> 8);
+        CCPR1L = (unsigned char)gGateMatch;
+        CCP1CON = 0x0A;
+        CCP1IF = 0;
+        CCP1IE = 1;
+    }
+
+    PEIE = 1;
+    Atomic_end(gie);
+}
+
+
+//////////////////////////////////
+//Pop the oldest sample from the measurement
+//queue.  Returns 0 if the queue is empty.
+unsigned char Sample_get(Sample* sample)
+{
+    if (sampleTail == sampleHead)
+        return 0;
+
+    sample->ticks = sampleQueue[sampleTail].ticks;
+    sample->overflows = sampleQueue[sampleTail].overflows;
+    sample->range = sampleQueue[sampleTail].range;
+    sample->flags = sampleQueue[sampleTail].flags;
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+    sample->stamp = sampleQueue[sampleTail].stamp;
+    sample->dropped = sampleQueue[sampleTail].dropped;
+#endif
+    sampleTail = (sampleTail + 1) & SAMPLE_QUEUE_MASK;
+    TRACE_MAIN(TRACE_SAMPLE);
+
+    return 1;
+}
+
+
+//////////////////////////////////
+//Total timer1 ticks over the gate, each
+//overflow is 0x10000 ticks.
+unsigned long Sample_getTicks(Sample* sample)
+{
+    return ((unsigned long)sample->overflows << 16) + sample->ticks;
+}
+
+
+//////////////////////////////////
+//freq = factor / timer1 ticks
+//factor accounts for num cycles, timer0 and
+//timer1 prescalers and the fixed point places
+//of the range the sample was taken in.
+//Direct count samples are freq = factor * edges.
+unsigned long Sample_toFrequency(Sample* sample)
+{
+    unsigned long ticks;
+
+    if (sample->flags & SAMPLE_NO_SIGNAL)
+        return 0;
+
+    ticks = Sample_getTicks(sample);
+
+    //direct count - ticks are edges (or timer0
+    //counts) over a fixed gate, scale up
+    if (sample->range >= RANGE_DIRECT)
+        return ticks * gRangeTable[sample->range].factor;
+
+    if (!ticks)      //avoid / 0
+        ticks = 1;
+
+    //run time trigger, Config_apply dropped any
+    //samples from before it
+    if (gConfig.trigger)
+        return gConfigFactor / ticks;
+
+    return gRangeTable[sample->range].factor / ticks;
+}
+
+
+//////////////////////////////////
+//Load the timer0 and timer1 prescalers and the
+//timer0 reload value for a range, or the config
+//trigger.  Called from
+//the isr at gate close only, the caller then
+//reloads TMR0 which also clears the timer0
+//prescaler.
+//
+//Capture ranges turn CCP1 off before loading
+//the new mode, a direct switch between capture
+//prescalers can give a false interrupt.  That
+//also clears the capture prescaler, so the next
+//capture only opens a gate.
+//
+//t0ps includes PSA, the direct count range 10
+//hands the prescaler to the wdt for 1:1.  The
+//wdt only runs over sleep (Power_sleep), so no
+//clrwdt sequence is needed, and PS is 1:1 there
+//so the sleep period does not change.
+void Range_apply(unsigned char range)
+{
+    if (gRangeTable[range].ccp1con)
+    {
+        CCP1CON = 0x00;
+        CCP1CON = gRangeTable[range].ccp1con;
+        CCP1IF = 0;
+        gGateSkip = 1;
+    }
+    else
+    {
+        OPTION_REG = (OPTION_REG & 0xF0) | gRangeTable[range].t0ps;
+        gRangeReload = gRangeTable[range].reload;
+
+        //run time trigger, Config_apply checked it
+        //goes with this range
+        if (gConfig.trigger)
+            gRangeReload = 0x00 - gConfig.trigger;
+    }
+
+    T1CON = (T1CON & 0xCF) | gRangeTable[range].t1ps;
+    gRange = range;
+    TRACE(TRACE_RANGE + range);
+}
+
+
+//////////////////////////////////
+//Auto range - step up a range when the gate
+//was too short for good resolution, down when
+//it was too long.  Samples still in flight from
+//an older range are ignored.
+//
+//Stepping down restarts the gate here, main
+//loop only.  Otherwise the gate already open in
+//the old range has to close (or time out) as
+//well before the new one applies.
+void Range_update(Sample* sample)
+{
+    unsigned long ticks;
+
+    if ((gConfig.range != RANGE_AUTO) || (sample->range != gRangeRequest))
+        return;
+
+    //timed out, gate as long as it gets
+    if (sample->flags & SAMPLE_NO_SIGNAL)
+        ticks = 0xFFFFFFFF;
+    else
+        ticks = Sample_getTicks(sample);
+
+    //direct count - more edges, more prescale
+    if (gMode == MODE_DIRECT)
+    {
+        if ((ticks > DIRECT_COUNT_UP) && (gRangeRequest < gModeLastRange[gMode]))
+            gRangeRequest++;
+        else if ((ticks < DIRECT_COUNT_DOWN) && (gRangeRequest > gModeFirstRange[gMode]))
+            gRangeRequest--;
+        return;
+    }
+
+    if ((ticks < RANGE_TICKS_MIN) && (gRangeRequest < gModeLastRange[gMode]))
+        gRangeRequest++;
+    else if ((ticks > RANGE_TICKS_MAX) && (gRangeRequest > gModeFirstRange[gMode]))
+    {
+        gRangeRequest--;
+        Gate_restart();
+    }
+}
+
+
+//////////////////////////////////
+//Auto range, the gate still open.  Once it has
+//run past RANGE_TICKS_MAX it will step down when
+//it closes, so step now.  A slow input gets to
+//the slower ranges without waiting out a whole
+//gate, or the TIMER1_OVERFLOW_LIMIT timeout, in
+//each one on the way.  Main loop only.
+//
+//The wait for the edge that opens the gate
+//counts too (gGateStart is the restart then),
+//it is no more edges than the gate itself.
+void Range_check(void)
+{
+    unsigned long open;
+    unsigned char gie;
+
+    if ((gConfig.range != RANGE_AUTO) || (gMode == MODE_DIRECT))
+        return;
+    if ((gRange != gRangeRequest) || (gRangeRequest <= gModeFirstRange[gMode]))
+        return;
+
+    gie = Atomic_begin();
+    open = Timer1_getValue32() - gGateStart;
+    Atomic_end(gie);
+
+    if (open > RANGE_TICKS_MAX)
+    {
+        gRangeRequest--;
+        Gate_restart();
+    }
+}
+
+
+
+//////////////////////////////////
+//One reading over the usart, a frame or
+//Freq: 1234.5hz, Freq: no signal if the gate
+//timed out (or none has closed yet)
+void Frequency_report(unsigned long freq)
+{
+    unsigned char info;
+
+    TRACE_MAIN(TRACE_REPORT);
+
+    if (gOutputMode == OUTPUT_BINARY)
+    {
+        info = gFreqRange | (gRangeTable[gFreqRange].decimals << 4);
+        if (gSample.flags & SAMPLE_NO_SIGNAL)
+            info |= FRAME_NO_SIGNAL;
+
+        Frame_send(freq, info);
+        return;
+    }
+
+    //a timeout is not a 0hz reading
+    if (gSample.flags & SAMPLE_NO_SIGNAL)
+    {
+        USART_WriteString("Freq: no signal\r\n");
+        return;
+    }
+
+    USART_WriteString("Freq: ");
+    n = Frequency_format(freq, gRangeTable[gFreqRange].decimals, outbuffer);
+
+    USART_Write(outbuffer, n);
+    USART_WriteString("hz\r\n");
+}
+
+
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+//////////////////////////////////
+//OUTPUT_STREAM, send everything the isr has
+//queued.  The timer1 steps since the previous
+//sample ran at the prescale of this sample's
+//range (the range only changes at gate close),
+//so they scale to cycles with a shift.
+void Stream_service(void)
+{
+    unsigned long freq;
+    unsigned char info, lost;
+
+    while (Sample_get(&gSample))
+    {
+        //isr queue drops before this one, skip
+        //them in the sequence
+        lost = gSample.dropped - gStreamLost;
+        gStreamLost = gSample.dropped;
+        gFrameSeq += lost;
+
+        gStreamTime += (gSample.stamp - gStreamStamp) << (gRangeTable[gSample.range].t1ps >> 4);
+        gStreamStamp = gSample.stamp;
+
+        freq = Sample_toFrequency(&gSample);
+        gFreqRange = gSample.range;
+        gFreq = freq;
+
+        info = gFreqRange | (gRangeTable[gFreqRange].decimals << 4);
+        if (gSample.flags & SAMPLE_NO_SIGNAL)
+            info |= FRAME_NO_SIGNAL;
+
+        Stream_send(freq, info, gStreamTime);
+
+#ifdef USE_AUTORANGE
+        Range_update(&gSample);
+#endif
+    }
+
+#ifdef USE_AUTORANGE
+    Range_check();
+#endif
+}
+#endif
+
+
+
+#ifdef USE_SLEEP
+//////////////////////////////////
+//Wake sources and the awake counter.  The byte
+//that wakes the part is thrown away, the rest of
+//a line sent while awake goes to the rx queue.
+void Power_init(void)
+{
+    CREN = 1;
+    TMR2IF = 0;
+    TMR2IE = 1;
+    PEIE = 1;
+}
+
+
+//////////////////////////////////
+//Restart the gate and wait for a reading.  The
+//core stays at full speed, the timers need fosc.
+//Autorange can take a few gates to settle, a
+//reading in a range it is leaving is not
+//returned.  No signal is returned once the
+//range has nowhere slower to go (or is held),
+//it won't get better by waiting.
+unsigned long Power_measure(void)
+{
+    unsigned long freq;
+
+    if (gPowerQuiet)
+        return 0;
+
+    Gate_restart();
+    while (1)
+    {
+        if (!Sample_get(&gSample))
+        {
+#ifdef USE_AUTORANGE
+            Range_check();
+#endif
+            HAL_POLL(20);
+            continue;
+        }
+
+        freq = Sample_toFrequency(&gSample);
+        gFreqRange = gSample.range;
+
+#ifdef USE_AUTORANGE
+        Range_update(&gSample);
+#endif
+
+        //a timeout that stepped the range down
+        //is not the answer yet
+        if (gRangeRequest == gSample.range)
+            return Filter_put(&gSample, freq);
+    }
+}
+
+
+//////////////////////////////////
+//Stop the measurement and sleep.  Interrupts
+//are off over the sleep, the wake sources only
+//wake, their flags are cleared here.  Timer0 and
+//CCP1 stay off until Gate_restart.
+void Power_sleep(void)
+{
+    unsigned char pie, i;
+
+    Power_txWait();
+
+    GIE = 0;
+    T0IE = 0;
+    CCP1CON = 0x00;
+    sampleTail = sampleHead;        //drop the part gate
+
+    pie = PIE1;
+    PIE1 = 0x00;
+
+    //rx - the isr has taken what came in while
+    //awake, this only clears OERR
+    CREN = 0;
+    CREN = 1;
+    while (RCIF)
+        i = RCREG;
+    WUE = 1;
+    RCIE = 1;
+
+    //no signal - wake when RA2 moves
+    gPowerQuiet = 0;
+    if (gSample.flags & SAMPLE_NO_SIGNAL)
+    {
+        IOCA |= (1u << 2);
+        i = PORTA;                  //ends the mismatch
+        RABIF = 0;
+        RABIE = 1;
+    }
+
+    TRACE(TRACE_SLEEP);
+    WDTCON = (POWER_WDTPS << 1) | 0x01;     //SWDTEN
+    for (i = 0 ; i < gPowerSleepPeriods ; i++)
+    {
+        HAL_SLEEP();
+        if (RCIF || RABIF)
+            break;
+        gPowerAsleepMs += POWER_PERIOD_MS;
+    }
+    WDTCON = (POWER_WDTPS << 1);
+    TRACE(TRACE_WAKE);
+
+    if ((gSample.flags & SAMPLE_NO_SIGNAL) && !RABIF)
+        gPowerQuiet = 1;
+
+    //the wake byte, WUE clears itself on it
+    WUE = 0;
+    while (RCIF)
+        i = RCREG;
+
+    RABIE = 0;
+    IOCA &=~ (1u << 2);
+    RABIF = 0;
+
+    PIE1 = pie;
+    GIE = 1;
+}
+
+
+//////////////////////////////////
+//Awake: 1234ms
+//Asleep: 5678ms
+//The ring only holds one line, let each go out.
+void Power_report(void)
+{
+    unsigned long awake;
+
+    awake = Atomic_readLong(&gPowerAwakeMs);
+
+    Power_txWait();
+    USART_WriteString("Awake: ");
+    n = dec2Buff(awake, outbuffer);
+    USART_Write(outbuffer, n);
+    USART_WriteString("ms\r\n");
+
+    Power_txWait();
+    USART_WriteString("Asleep: ");
+    n = dec2Buff(gPowerAsleepMs, outbuffer);
+    USART_Write(outbuffer, n);
+    USART_WriteString("ms\r\n");
+}
+
+
+//////////////////////////////////
+//Wait for the tx ring to empty and the last
+//byte to leave the shift register.
+void Power_txWait(void)
+{
+    while (TXIE || !TRMT){HAL_POLL(10);};
+}
+#endif
+
+
+
+//////////////////////////////////
+//Queue one binary frame, see OUTPUT_BINARY.
+//info is byte 2, range / decimals / flags.
+void Frame_send(unsigned long value, unsigned char info)
+{
+    unsigned char frame[FRAME_SIZE];
+
+    frame[0] = FRAME_SYNC;
+    frame[1] = gFrameSeq++;
+    frame[2] = info;
+    frame[3] = (unsigned char)value;
+    frame[4] = (unsigned char)(value >> 8);
+    frame[5] = (unsigned char)(value >> 16);
+    frame[6] = (unsigned char)(value >> 24);
+
+    if (!Frame_queue(frame, FRAME_SIZE))
+        gFrameDropped++;
+}
+
+
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+//////////////////////////////////
+//Queue one OUTPUT_STREAM frame, stamp in
+//cycles.  Counted in gStreamDropped if the tx
+//ring has no room, the sequence still moves.
+void Stream_send(unsigned long value, unsigned char info, unsigned long stamp)
+{
+    unsigned char frame[STREAM_FRAME_SIZE];
+
+    frame[0] = STREAM_SYNC;
+    frame[1] = gFrameSeq++;
+    frame[2] = info;
+    frame[3] = (unsigned char)value;
+    frame[4] = (unsigned char)(value >> 8);
+    frame[5] = (unsigned char)(value >> 16);
+    frame[6] = (unsigned char)(value >> 24);
+    frame[7] = (unsigned char)stamp;
+    frame[8] = (unsigned char)(stamp >> 8);
+    frame[9] = (unsigned char)(stamp >> 16);
+    frame[10] = (unsigned char)(stamp >> 24);
+
+    if (!Frame_queue(frame, STREAM_FRAME_SIZE))
+        gStreamDropped++;
+}
+#endif
+
+
+//////////////////////////////////
+//crc in the last byte, then into the tx ring
+//whole or not at all.  Returns 0 if there was
+//no room.
+unsigned char Frame_queue(unsigned char* frame, unsigned char size)
+{
+    unsigned char i, crc = 0x00;
+
+    for (i = 0 ; i < (size - 1) ; i++)
+        crc = Crc8_update(crc, frame[i]);
+    frame[size - 1] = crc;
+
+    if (USART_TxFree() < size)
+        return 0;
+
+    USART_Write((char*)frame, size);
+    return 1;
+}
+
+
+
+////////////////////////////////////////////////
+//set up the serial transimitter - much of this is from
+//section 12.1 of the user manual
+	
+//setup the baud rate - use SPBRGH, SPBRG, BRGH, and BRG16 bits
+//see section 12.3
+//16 bit generator, BRGH = 1 and BRG16 = 1, SPBRGH:SPBRG
+//from BAUD_SPBRG, see BAUD_RATE at the top
+
+void USART_init(void)
+{
+    //baud rate
+	SPBRGH = (unsigned char)(BAUD_SPBRG >> 8);
+	SPBRG = (unsigned char)BAUD_SPBRG;
+
+	//8 bit async mode - see table 12-3
+	SYNC = 0;       //enable async opperation
+	BRGH = 1;
+	BRG16 = 1;
+
+	//enable the serial port - clear the SYNC bit and 
+	//set the SPEN bit.  Clearing the SYNC 
+	SYNC = 0;       //enable async opperation
+	SPEN = 1;       //auto config tx/rx pins as output/input
+
+    //transmitter stays enabled, the tx ring
+    //isr feeds TXREG, see USART_Write
+    TXIE = 0;       //enabled when data is queued
+    TXEN = 1;
+
+    //receiver, lines go to the rx queue
+    CREN = 1;
+    RCIE = 1;
+    PEIE = 1;       //peripheral interrupts, GIE set in Timer0_init
+
+}
+
+
+
+///////////////////////////////////////
+//Commands, from USART_ProcessCommand
+
+unsigned char Cmd_trace(void)
+{
+#ifdef USE_TRACE
+    Trace_dump();
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+//hold a range, or auto range again.  apply
+//checks it is one of the mode's.
+unsigned char Cmd_range(void)
+{
+    if (!gCommandHasArg)
+    {
+#ifdef USE_AUTORANGE
+        gConfigNext.range = RANGE_AUTO;
+        return 1;
+#else
+        return 0;
+#endif
+    }
+
+    if (gCommandArg > RANGE_MAX)
+        return 0;
+
+    gConfigNext.range = (unsigned char)gCommandArg;
+    return 1;
+}
+
+
+//waits for room for the whole reading first, a
+//periodic one still going out would cut it short
+unsigned char Cmd_sample(void)
+{
+    if (gOutputMode == OUTPUT_BINARY)
+        USART_TxWait(FRAME_SIZE);
+    else
+        USART_TxWait(REPORT_TEXT_MAX);
+
+    Frequency_report(gFreq);
+    return 1;
+}
+
+
+unsigned char Cmd_rate(void)
+{
+    if ((gCommandArg < RATE_MIN) || (gCommandArg > RATE_MAX))
+        return 0;
+
+    gConfigNext.rate = gCommandArg;
+    return 1;
+}
+
+
+//task N runs N late N worst N (USE_SCHED_STATS)
+//drop sample N frame N stream N tx N rx N
+//stream only with OUTPUT_STREAM
+unsigned char Cmd_stats(void)
+{
+#ifdef USE_SCHED_STATS
+    unsigned char i;
+#endif
+
+#ifdef USE_SCHED_STATS
+    for (i = 0 ; i < TASK_COUNT ; i++)
+    {
+        Command_value("task ", i);
+        Command_value(" runs ", gTaskState[i].runs);
+        Command_value(" late ", gTaskState[i].late);
+        Command_value(" worst ", gTaskState[i].worst);
+        USART_TxWait(2);
+        USART_WriteString("\r\n");
+    }
+#endif
+
+    Command_value("drop sample ", Atomic_readInt(&gSampleDropped));
+    Command_value(" frame ", gFrameDropped);
+#if (OUTPUT_MODE == OUTPUT_STREAM)
+    Command_value(" stream ", gStreamDropped);
+#endif
+    Command_value(" tx ", gTxDropped);
+    Command_value(" rx ", Atomic_readInt(&gRxOverrun));
+    USART_TxWait(2);
+    USART_WriteString("\r\n");
+    return 1;
+}
+
+
+//a new mode starts at its default range, or
+//auto
+unsigned char Cmd_mode(void)
+{
+    if (gCommandArg > MODE_DIRECT)
+        return 0;
+
+    gConfigNext.mode = (unsigned char)gCommandArg;
+#ifdef USE_AUTORANGE
+    gConfigNext.range = RANGE_AUTO;
+#else
+    gConfigNext.range = gModeDefaultRange[gConfigNext.mode];
+#endif
+    return 1;
+}
+
+
+unsigned char Cmd_trigger(void)
+{
+    if (gCommandArg > 0xFF)
+        return 0;
+
+    gConfigNext.trigger = (unsigned char)gCommandArg;
+    return 1;
+}
+
+
+unsigned char Cmd_tune(void)
+{
+    if (gCommandArg > TUNE_MAX)
+        return 0;
+
+    gConfigNext.tune = (unsigned char)gCommandArg;
+    return 1;
+}
+
+
+unsigned char Cmd_apply(void)
+{
+    return Config_apply();
+}
+
+
+//mode 0 range 1 trig 0 tune 3 rate 1000, range
+//255 is auto
+unsigned char Cmd_config(void)
+{
+    Command_value("mode ", gConfig.mode);
+    Command_value(" range ", gConfig.range);
+    Command_value(" trig ", gConfig.trigger);
+    Command_value(" tune ", gConfig.tune);
+    Command_value(" rate ", gConfig.rate);
+    USART_TxWait(2);
+    USART_WriteString("\r\n");
+    return 1;
+}
+
+
+///////////////////////////////////////
+//Power up settings, see gConfig
+void Config_init(void)
+{
+    gConfigNext.mode = MEASURE_MODE;
+#ifdef USE_AUTORANGE
+    gConfigNext.range = RANGE_AUTO;
+#else
+    gConfigNext.range = gModeDefaultRange[MEASURE_MODE];
+#endif
+    gConfigNext.trigger = 0x00;
+    gConfigNext.tune = CONFIG_TUNE;
+    gConfigNext.rate = CONFIG_RATE;
+}
+
+
+///////////////////////////////////////
+//Check gConfigNext and put it in effect, 0 if
+//it does not fit together (gConfig unchanged).
+//
+//A trigger needs counter mode and a fixed range.
+//The range factor is for its own trigger, so it
+//is scaled to edges per trigger - exact for
+//every counter range - and checked to still fit
+//32 bits.  The division is here, once, not per
+//reading.
+//
+//The measurement part is one atomic section,
+//the same as a mode change used to be: restart
+//the gate at the new range and drop the queued
+//samples, the isr never sees half a config.
+unsigned char Config_apply(void)
+{
+    unsigned char gie;
+    unsigned char range = gConfigNext.range;
+    unsigned char mode = gConfigNext.mode;
+    unsigned long edge = 0x00;
+
+    if (range == RANGE_AUTO)
+        range = gModeDefaultRange[mode];
+    else if ((range < gModeFirstRange[mode]) || (range > gModeLastRange[mode]))
+        return 0;
+
+    if (gConfigNext.trigger)
+    {
+        if ((mode != MODE_COUNTER) || (gConfigNext.range == RANGE_AUTO))
+            return 0;
+
+        edge = gRangeTable[range].factor / (unsigned char)(0x00 - gRangeTable[range].reload);
+        if (gConfigNext.trigger > 0xFFFFFFFF / edge)
+            return 0;
+    }
+
+    gie = Atomic_begin();
+
+    gConfig = gConfigNext;
+    gConfigFactor = edge * gConfig.trigger;
+    ClockTune(gConfig.tune);
+
+#ifdef USE_COUNTER
+    gMode = mode;
+    gRangeRequest = range;
+    Gate_restart();
+    sampleTail = sampleHead;
+#endif
+
+    Atomic_end(gie);
+
+    Sched_setPeriod(TASK_REPORT, gConfig.rate);
+
+#ifdef USE_SLEEP
+    gPowerSleepPeriods = (unsigned char)(gConfig.rate / POWER_PERIOD_MS);  //RATE_MIN / MAX keep it 1 - 255
+#endif
+    return 1;
+}
+
+
+#ifdef USE_TRACE
+///////////////////////////////////////
+//Command 'd' - the trace ring, oldest first:
+//
+//  trace: t1ps 8
+//  02 41533 +2500
+//
+//event id in hex, TRACE_xxx, the timer1 count
+//and the ticks since the entry before.  Tracing
+//stops over the dump so the ring holds still,
+//and the dump waits for room in the tx ring, so
+//a few samples may drop meanwhile - they are
+//counted as usual.  A line goes out in two
+//writes, outbuffer is shorter than the line.
+#define TRACE_LINE_MAX      17
+
+void Trace_dump(void)
+{
+    unsigned char i, index, event;
+    unsigned char first = 1;
+    unsigned int last = 0x00;
+    unsigned int delta;
+
+    gTraceOn = 0;
+
+    USART_TxWait(TRACE_LINE_MAX);
+    USART_WriteString("trace: t1ps ");
+    n = dec2Buff(1u << ((T1CON >> 4) & 0x03), outbuffer);
+    outbuffer[n++] = '\r';
+    outbuffer[n++] = '\n';
+    USART_Write(outbuffer, n);
+
+    for (i = 0 ; i < TRACE_SIZE ; i++)
+    {
+        index = (gTraceHead + i) & TRACE_MASK;
+        event = gTraceEvent[index];
+        if (event == TRACE_EMPTY)
+            continue;
+
+        outbuffer[0] = "0123456789ABCDEF"[event >> 4];
+        outbuffer[1] = "0123456789ABCDEF"[event & 0x0F];
+        outbuffer[2] = ' ';
+        n = 3 + dec2Buff(gTraceTime[index], outbuffer + 3);
+        outbuffer[n++] = ' ';
+        outbuffer[n++] = '+';
+
+        USART_TxWait(TRACE_LINE_MAX);
+        USART_Write(outbuffer, n);
+
+        //16 bit difference, wraps with timer1
+        delta = first ? 0 : (gTraceTime[index] - last) & 0xFFFF;
+        n = dec2Buff(delta, outbuffer);
+        outbuffer[n++] = '\r';
+        outbuffer[n++] = '\n';
+        last = gTraceTime[index];
+        first = 0;
+
+        USART_Write(outbuffer, n);
+    }
+
+    gTraceOn = 1;
+}
+#endif
+
+
+
+///////////////////////////////////////////
+//Fixed point value to text, decimals is the
+//number of places after the point, ie 1234
+//with 3 decimals -> "1.234", 5 -> "0.005".
+//Returns num chars, buffer is null terminated.
+unsigned char Frequency_format(unsigned long val, unsigned char decimals, char* buffer)
+{
+    unsigned char i;
+    unsigned char num;
+
+    num = dec2Buff(val, buffer);
+    if (decimals == 0)
+        return num;
+
+    //leading zeros so there is a digit before the point
+    while (num <= decimals)
+    {
+        for (i = num + 1 ; i > 0 ; i--)
+            buffer[i] = buffer[i - 1];
+        buffer[0] = '0';
+        num++;
+    }
+
+    //open a gap for the point, null included
+    for (i = num + 1 ; i > (num - decimals) ; i--)
+        buffer[i] = buffer[i - 1];
+    buffer[num - decimals] = '.';
+
+    return num + 1;
+}
+
+
+
+#ifdef DEC2BUFF_BENCH
+///////////////////////////////////////////
+//original dec2Buff - long divide and modulus
+//per digit, then reverse.  Kept only for
+//the cycle count comparison.
+unsigned char dec2BuffDiv(unsigned long val, char* buffer)
+{
+    unsigned char i = 0;
+    char digit;
+    unsigned char num = 0;
+    char t;
+
+    while (val > 0)
+    {
+        digit = (char)(val % 10);
+        buffer[num] = (0x30 + digit) & 0x7F;
+        num++;          
+        val = val / 10;
+    }
+
+    //reverse in place
+    for (i = 0 ; i < num / 2 ; i++)
+    {
+        t = buffer[i];
+        buffer[i] = buffer[num - i - 1];
+        buffer[num - i - 1] = t;
+    }  
+
+    buffer[num] = 0x00;     //null terminated
+    
+    return num;
+}
+
+
+///////////////////////////////////////////
+//Cycle count comparison, old vs new dec2Buff.
+//Timer1 runs at fosc/4 with 1:8 prescale, so
+//each timer1 tick is 8 instruction cycles.
+//Interrupts are off while timing so the isr
+//does not add to the count.
+//Output per value:
+//dec2Buff <value> div: <cycles> sub: <cycles>
+//
+__code const unsigned long gBenchValues[5] = {
+    7, 65535, 1234567, 99999999, 4294967295
+};
+
+void Dec2Buff_bench(void)
+{
+    unsigned char i;
+    unsigned int ticksDiv, ticksSub;
+    unsigned long val;
+
+    for (i = 0 ; i < 5 ; i++)
+    {
+        val = gBenchValues[i];
+
+        GIE = 0;
+        ticksDiv = Timer1_getValue();
+        dec2BuffDiv(val, outbuffer);
+        ticksDiv = Timer1_getValue() - ticksDiv;
+
+        ticksSub = Timer1_getValue();
+        dec2Buff(val, outbuffer);
+        ticksSub = Timer1_getValue() - ticksSub;
+        GIE = 1;
+
+        //let the tx ring drain between lines
+        while (txHead != txTail){HAL_POLL(4);};
+
+        USART_WriteString("dec2Buff ");
+        n = dec2Buff(val, outbuffer);
+        USART_Write(outbuffer, n);
+        while (txHead != txTail){HAL_POLL(4);};
+
+        USART_WriteString(" div: ");
+        n = dec2Buff((unsigned long)ticksDiv * 8, outbuffer);
+        USART_Write(outbuffer, n);
+        USART_WriteString(" sub: ");
+        n = dec2Buff((unsigned long)ticksSub * 8, outbuffer);
+        USART_Write(outbuffer, n);
+        USART_WriteString("\r\n");
+    }
+}
+#endif
 
 
 
+#include "../common/sched.c"
+#include "../common/timer2.c"
+#include "../common/usart.c"
@@ -24,7 +24,7 @@ from pile counter code.
 
 */
 
-#include <pic16f690.h>
+#include "../hal/hal.h"
 
 ////////////////////////////////////////////////
 //Set the appropriate config bits
@@ -33,6 +33,26 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 ////////////////////////////////////////////////
 
 
+////////////////////////////////////////////////
+//System clock, ClockConfig sets the internal osc
+//to this, any of 1, 2, 4, 8mhz.  The timer2 tick
+//(../common/sched.h) and the baud rate divisor
+//(../common/usart.h) work from it at compile
+//time.
+#define SYSTEM_CLOCK        8000000
+
+//usart baud rate, checked against what
+//SYSTEM_CLOCK can do, see ../common/usart.h
+#define BAUD_RATE           57600
+#define BAUD_ERROR_MAX      20                  //per mille
+
+//command u - the ok goes out at the old rate,
+//then send a 'U' within AUTOBAUD_WAIT_MS at the
+//new one.  "baud ok" (or "baud ?", old rate
+//kept) follows.  See gAutoBaud.
+#define AUTOBAUD_WAIT_MS    5000
+
+
 ////////////////////////////////////////////////
 //configure as timer or counter
 //define counter ro run as counter
@@ -55,12 +75,65 @@ __code unsigned int __at (__CONFIG) cfg0 =  _CP_OFF & _CPD_OFF & _BOREN_OFF & _W
 volatile unsigned int gTimerTick = 0x00;
 unsigned int gCycleCounter = 0x00;
 
-volatile unsigned char gActiveFrequency = 1;
-volatile unsigned long gFrequency1 = 0x00;
-volatile unsigned long gFrequency2 = 0x00;
+////////////////////////////////////
+//task scheduler and software timers, see
+//../common/sched.h
+//
+//Command lines are not a task, USART_ServiceRx
+//runs every pass of the loop.  USE_SCHED_STATS
+//keeps runs / late / worst for stats.
+#define USE_SCHED_STATS     1
+#define TASK_COUNT          2
+#define TIMER_COUNT         2
+#define TIMER_SERIAL        0       //usart timeouts, polled
+#define TIMER_LED           1       //status led pattern
+
+#include "../common/sched.h"
+
+void Task_signal(void);
+void Task_report(void);
+void Report_service(void);
+void Baud_service(void);
+
+#define TASK_REPORT         1       //gTaskTable index
+
+__code const Task gTaskTable[TASK_COUNT] = {
+    {Task_signal,   1,      1},     //RC3 test signal, 500hz
+    {Task_report,   500,    100}    //two readings a second
+};
+
+//The text reading is two lines, up to 40 bytes,
+//more than the tx ring holds.  Task_report takes
+//the reading and Report_service sends it from
+//the main loop, each line once the ring has room
+//for all of it, so neither is cut short.  A
+//report still going out is not restarted.
+#define REPORT_DONE         0
+#define REPORT_HEAD         1       //"Freq: freq 1000 to 10000\r\n"
+#define REPORT_VALUE        2       //"1234hz\r\n"
+#define REPORT_HEAD_MAX     26
+unsigned char gReportStep = REPORT_DONE;
+
+void Led_step(void);
+
+__code const TimerCallback gTimerCallback[TIMER_COUNT] = {
+    0,                          //TIMER_SERIAL
+    Led_step                    //TIMER_LED
+};
+
+//status led, one bit of the pattern every
+//LED_STEP_MS, lsb first
+#define LED_STEP_MS         125
+#define LED_SIGNAL          0x01        //short flash a second
+#define LED_NO_SIGNAL       0x55        //4hz blink
+unsigned char gLedStep = 0x00;
+
+//last gate, timer1 ticks - isr writes, main
+//copies with Atomic_readLong
+volatile unsigned long gFrequency = 0x00;
+
 
 
-void Delay(unsigned long val);
 void GPIO_init(void);
 void Timer0_init(void);
 void ClockConfig(unsigned long hz);
@@ -76,196 +149,439 @@ unsigned int Timer1_getValue(void);
 unsigned long Timer1_getFrequency(void);
 unsigned long gFreq;
 
-unsigned char dec2Buff(unsigned long val, char* buffer);
-void USART_init(void);
-void USART_Write(char* buffer, unsigned char length);
-void USART_WriteString(const char* buffer);
-void USART_ProcessCommand(unsigned char* buffer, unsigned char length);
+void Frame_send(unsigned long value, unsigned char info);
 
 
-unsigned char n;
-#define OUT_BUFFER_SIZE     32
+////////////////////////////////////
+//usart rings and command interpreter, see
+//../common/usart.h
+#define OUT_BUFFER_SIZE     16
+#define TX_BUFFER_SIZE      32
 #define RX_BUFFER_SIZE      16
-char outbuffer[OUT_BUFFER_SIZE];
 
-//receiver variables
-unsigned char rxIndex = 0x00;
-unsigned char rxBuffer[RX_BUFFER_SIZE];
+#include "../common/usart.h"
 
-////////////////////////////////////////
-//Interrupt Service Routine
-//number following inerrupt keyword
-//is the isr number.  there is only one
-//interrupt for the pic, so set to 0
+////////////////////////////////////
+//usart output format
+//OUTPUT_TEXT - "Freq: freq 1 to 1000\r\n" and the
+//digits, about 30 bytes and a digit loop.
+//OUTPUT_BINARY - one fixed 8 byte frame, nothing
+//formatted on the target:
 //
-//whne configured as counter, it triggers
-//on overflow.  
-static void irqHandler(void) __interrupt 0
-{    
-    unsigned char c = 0x00;
-    unsigned long tick = 0x00;
-    unsigned long counter = 0;
-      
-    //soucre = timer0 / counter0
-    if (T0IF == 1)
-    {
-
-#ifdef USE_COUNTER
-        
-        //compute the tick freq and store
-        //in non active freq and switch
-        //freq = counter * 1000000 / ticks
-        //
-        
-        //set timer value = 500
-        Timer1_setValue(800);
-
-        tick = Timer1_getValue();
-   //     counter = (unsigned long)COUNTER_TRIGGER * 2;
-
-   //     tick = 12345678;
+//byte  0     FRAME_SYNC 0xA5
+//      1     sequence, +1 every frame, dropped
+//            frames still count so gaps show
+//      2     bits 0-3 range, 4-5 decimals,
+//            6 FRAME_RAW, 7 FRAME_NO_SIGNAL
+//      3-6   value, 32 bit little endian, hz
+//            * 10^decimals, or timer1 ticks
+//            when FRAME_RAW is set.  Always raw
+//            here, range and decimals are 0.
+//      7     crc-8, poly 0x07, init 0x00, over
+//            bytes 0-6
+//
+//A frame only goes in the tx ring whole, if
+//there is no room it is dropped and counted in
+//gFrameDropped.  See tools/frame_decode.py.
+//Commands 't' and 'x' switch text / binary.
+#define OUTPUT_TEXT         0
+#define OUTPUT_BINARY       1
+#define OUTPUT_MODE         OUTPUT_TEXT
+
+#define FRAME_SIZE          8
+#define FRAME_SYNC          0xA5
+#define FRAME_RAW           0x40
+#define FRAME_NO_SIGNAL     0x80
+
+unsigned char gOutputMode = OUTPUT_MODE;
+unsigned char gFrameSeq = 0x00;
+unsigned int gFrameDropped = 0x00;
 
-    //    if (!tick)
-    //        tick = 1;
+////////////////////////////////////
+//commands, see ../common/usart.h
+//
+//  t           text output
+//  x           binary frames
+//  u           auto-baud, see AUTOBAUD_WAIT_MS
+//  i           interrupt counts, see Irq_report
+//  rate n      ms between readings, 10 - 60000
+//  sample      the latest reading, now
+//  stats       task and drop counters
+#define CMD_TEXT            0
+#define CMD_BINARY          1
+#define CMD_BAUD            2
+#define CMD_IRQ             3
+#define CMD_RATE            4
+#define CMD_SAMPLE          5
+#define CMD_STATS           6
+#define CMD_COUNT           7
+
+#define RATE_MIN            10
+#define RATE_MAX            60000
+
+unsigned char Cmd_text(void);
+unsigned char Cmd_binary(void);
+unsigned char Cmd_baud(void);
+unsigned char Cmd_irq(void);
+unsigned char Cmd_rate(void);
+unsigned char Cmd_sample(void);
+unsigned char Cmd_stats(void);
+
+__code const Command gCommandTable[CMD_COUNT] = {
+    {"t",       Cmd_text,   CMD_ARG_NONE},
+    {"x",       Cmd_binary, CMD_ARG_NONE},
+    {"u",       Cmd_baud,   CMD_ARG_NONE},
+    {"i",       Cmd_irq,    CMD_ARG_NONE},
+    {"rate",    Cmd_rate,   CMD_ARG_VALUE},
+    {"sample",  Cmd_sample, CMD_ARG_NONE},
+    {"stats",   Cmd_stats,  CMD_ARG_NONE}
+};
+
+//by Command_hash
+__code const unsigned char gCommandSlot[CMD_HASH_MASK + 1] = {
+    CMD_BAUD,    CMD_RATE,    CMD_NONE,    CMD_NONE,
+    CMD_SAMPLE,  CMD_NONE,    CMD_NONE,    CMD_NONE,
+    CMD_NONE,    CMD_BINARY,  CMD_NONE,    CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_NONE,    CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_STATS,   CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_NONE,    CMD_NONE,
+    CMD_NONE,    CMD_NONE,    CMD_NONE,    CMD_NONE,
+    CMD_IRQ,     CMD_TEXT,    CMD_NONE,    CMD_NONE
+};
 
-        if (gActiveFrequency == 1)
-        {
-           // gFrequency2 = counter * 1000000 / tick;
-            gFrequency2 = tick;
-            gActiveFrequency = 2;
-        }
-        else
-        {
-//            gFrequency1 = counter * 1000000 / tick;
-            gFrequency1 = tick;
-            gActiveFrequency = 1;
-        }
-        
-        //do something...
-        PORTC ^= (1u << 1);     //toggle RC1
-        TMR0 = COUNTER_RESET;   //load the initial count value
 
-        //reset timer
-    //    Timer1_reset();
+////////////////////////////////////
+//interrupt sources
+//One block per source, IRQ_DO_xxx below, tests
+//its enable and its flag and services it.  The
+//isr is IRQ_ORDER, the blocks pasted in that
+//order, so the list is the priority - earlier is
+//served first on the same entry.  Reorder it to
+//change that, at compile time.  No table and no
+//calls through pointers, they cost a lot on the
+//14 bit core.  A source can only be left out if
+//it is never enabled.
+//Sources this program does not enable just
+//clear their flag.
+//
+//With USE_IRQ_STATS each block is timed off
+//timer1, free running at 1:8 (4us a tick at
+//8mhz), from inside its if to the end of the
+//service - the entry and context save are not
+//in it.  gIrqStats keeps the count, the longest
+//and the sum per source, command 'i' prints
+//them, see Irq_report.  56 bytes of ram, see the
+//ram budget in main.c.
+#define USE_IRQ_STATS       1
+
+#define IRQ_ORDER                                               \
+    IRQ_DO_T0                                                   \
+    IRQ_DO_RC                                                   \
+    IRQ_DO_TX                                                   \
+    IRQ_DO_TMR2                                                 \
+    IRQ_DO_TMR1                                                 \
+    IRQ_DO_CCP1                                                 \
+    IRQ_DO_IOC                                                  \
+    IRQ_DO_AD
+
+#define IRQ_T0              0       //timer0 counter
+#define IRQ_TMR1            1
+#define IRQ_RC              2       //usart receive
+#define IRQ_TX              3       //usart transmit
+#define IRQ_CCP1            4
+#define IRQ_IOC             5       //RA / RB change
+#define IRQ_AD              6
+#define IRQ_TMR2            7       //1ms tick
+#define IRQ_COUNT           8
+
+#ifdef USE_IRQ_STATS
+__code const char* const gIrqName[IRQ_COUNT] = {
+    "t0", "tmr1", "rc", "tx", "ccp1", "ioc", "ad", "tmr2"
+};
+
+typedef struct
+{
+    unsigned int count;
+    unsigned char max;          //timer1 ticks, 255 at most
+    unsigned long sum;          //timer1 ticks
+} IrqStats;
+
+//isr writes, main reads with interrupts off
+volatile IrqStats gIrqStats[IRQ_COUNT];
+
+unsigned int gIrqStart;         //isr - timer1 at the block start
+unsigned int gIrqEnd;
+unsigned char gIrqHigh;         //IRQ_TIME scratch, TMR1H
+
+//timer1 high, low, high - read again if TMR1L
+//rolled over in between
+#define IRQ_TIME(t)                                             \
+    do {                                                        \
+        gIrqHigh = TMR1H;                                       \
+        t = TMR1L + ((unsigned int)gIrqHigh << 8);              \
+    } while (gIrqHigh != TMR1H)
+
+#define IRQ_START()         IRQ_TIME(gIrqStart)
+#define IRQ_SEEN(id)        do { IRQ_TIME(gIrqEnd); Irq_account(id); } while (0)
+
+void Irq_account(unsigned char id);
+
+//Irq_report, a line in two parts as the tx ring
+//has room, from a copy taken at the start of it
+#define IRQ_REPORT_DONE     0xFF
+#define IRQ_REPORT_ROOM     24      //"irq tmr1 n 65535 max 255"
+#define IRQ_REPORT_SUM      17      //" sum 4294967295\r\n"
+unsigned char gIrqReport = IRQ_REPORT_DONE;     //id * 2 + part
+IrqStats gIrqCopy;
+
+void Irq_report(void);
+#else
+#define IRQ_START()
+#define IRQ_SEEN(id)
+#endif
 
+////////////////////////////////////////
+//soucre = timer0 / counter0
+//whne configured as counter, it triggers
+//on overflow.  The gate is the timer1 ticks
+//since the last overflow, COUNTER_TRIGGER * 2
+//edges - 16 bits, up to 262ms.  Toggles RC1 and
+//loads TMR0 back to COUNTER_RESET.
+#ifdef USE_COUNTER
+unsigned int gGateLast = 0x00;      //isr - timer1 at the last overflow
+unsigned int gGateNow;
+
+#define IRQ_DO_T0                                               \
+    if ((T0IE == 1) && (T0IF == 1))                             \
+    {                                                           \
+        IRQ_START();                                            \
+        gGateNow = Timer1_getValue();                           \
+        gFrequency = (gGateNow - gGateLast) & 0xFFFF;           \
+        gGateLast = gGateNow;                                   \
+                                                                \
+        PORTC ^= (1u << 1);                                     \
+        TMR0 = COUNTER_RESET;                                   \
+        T0IF = 0;                                               \
+        IRQ_SEEN(IRQ_T0);                                       \
+    }
 #else
-        gTimerTick++;
+#define IRQ_DO_T0                                               \
+    if ((T0IE == 1) && (T0IF == 1))                             \
+    {                                                           \
+        IRQ_START();                                            \
+        gTimerTick++;                                           \
+        T0IF = 0;                                               \
+        IRQ_SEEN(IRQ_T0);                                       \
+    }
 #endif
-        T0IF = 0;
+
+//usart, see USART_rxIsr / USART_txIsr.  TXIF
+//stays set while TXREG is empty, so only while
+//TXIE is on.
+#define IRQ_DO_RC                                               \
+    if ((RCIE == 1) && (RCIF == 1))                             \
+    {                                                           \
+        IRQ_START();                                            \
+        USART_rxIsr();                                          \
+        IRQ_SEEN(IRQ_RC);                                       \
     }
 
+#define IRQ_DO_TX                                               \
+    if ((TXIE == 1) && (TXIF == 1))                             \
+    {                                                           \
+        IRQ_START();                                            \
+        USART_txIsr();                                          \
+        IRQ_SEEN(IRQ_TX);                                       \
+    }
 
-    ////////////////////////////////////////
-    //receiver interrupt
-    if (RCIF == 1)    
-    {
-        c = RCREG;
+//timer2 - 1ms, scheduler tick
+#define IRQ_DO_TMR2                                             \
+    if ((TMR2IE == 1) && (TMR2IF == 1))                         \
+    {                                                           \
+        IRQ_START();                                            \
+        TMR2IF = 0;                                             \
+        gSchedPending++;                                        \
+        Timer_tick();                                           \
+        IRQ_SEEN(IRQ_TMR2);                                     \
+    }
 
-        if ((rxIndex < (RX_BUFFER_SIZE - 1)) && (c != 0x00))
-        {
-            rxBuffer[rxIndex] = c;
-            rxIndex++;
-
-            //end of message?
-            if (c == '\n')
-            {
-                rxBuffer[rxIndex] = 0x00;
-                USART_ProcessCommand(rxBuffer, rxIndex);
-                rxIndex = 0x00;
-            }
-        }
+//not enabled here, clear and count
+#define IRQ_DO_TMR1                                             \
+    if ((TMR1IE == 1) && (TMR1IF == 1))                         \
+    {                                                           \
+        IRQ_START();                                            \
+        TMR1IF = 0;                                             \
+        IRQ_SEEN(IRQ_TMR1);                                     \
+    }
+
+#define IRQ_DO_CCP1                                             \
+    if ((CCP1IE == 1) && (CCP1IF == 1))                         \
+    {                                                           \
+        IRQ_START();                                            \
+        CCP1IF = 0;                                             \
+        IRQ_SEEN(IRQ_CCP1);                                     \
+    }
 
+//reading the ports ends the mismatch, or the
+//flag comes straight back
+#define IRQ_DO_IOC                                              \
+    if ((RABIE == 1) && (RABIF == 1))                           \
+    {                                                           \
+        IRQ_START();                                            \
+        (void)PORTA;                                            \
+        (void)PORTB;                                            \
+        RABIF = 0;                                              \
+        IRQ_SEEN(IRQ_IOC);                                      \
+    }
 
-        RCIF = 0;        
+#define IRQ_DO_AD                                               \
+    if ((ADIE == 1) && (ADIF == 1))                             \
+    {                                                           \
+        IRQ_START();                                            \
+        ADIF = 0;                                               \
+        IRQ_SEEN(IRQ_AD);                                       \
     }
 
+////////////////////////////////////////
+//Interrupt Service Routine
+//number following inerrupt keyword
+//is the isr number.  there is only one
+//interrupt for the pic, so set to 0
+//
+//The sources in IRQ_ORDER, see above.
+HAL_INTERRUPT(irqHandler)
+{
+    IRQ_ORDER
 }
 
 
 /////////////////////////////////////
 int main()
 {
-    ClockConfig(8000000);   //125, 250hz, 500, 1000hz
+    ClockConfig(SYSTEM_CLOCK);  //125, 250hz, 500, 1000hz
     GPIO_init();
     Timer0_init();
+    Timer2_init();
+    Timer_init();
     Timer1_init();
     USART_init();
 
+    Sched_init();
+    Timer_start(TIMER_LED, LED_STEP_MS, LED_STEP_MS);
+
     while (1)
     {
-        //status led
-        PORTC ^= (1 << 0);
+        //whatever is due, see gTaskTable and
+        //gTimerCallback
+        Sched_run();
+        Timer_service();
+
+        //parse any command lines posted by the isr
+        USART_ServiceRx();
+        Report_service();
+        Baud_service();
+#ifdef USE_IRQ_STATS
+        Irq_report();
+#endif
 
-        //toggle RC3 and connect to RA2
-        //RA2 is the input pin to counter.
-        //RC3 is connected to pin 7
-        //RA2 is pin 17
-        PORTC ^= (1 << 3);
+        HAL_POLL(20);
+        gCycleCounter++;
+    }
 
-        //output the value over usart every 100 cycles
-        if (!(gCycleCounter % 500))
-        {
-            USART_WriteString("Freq: ");
-
-            gFreq = Timer1_getFrequency();
-
-            if (gFreq == 0)
-            {
-                USART_WriteString("zero freq\r\n");
-            }
-            else if ((gFreq > 0) && (gFreq <= 1000))
-            {
-                USART_WriteString("freq 1 to 1000\r\n");
-            }
-
-            else if ((gFreq > 1000) && (gFreq <= 10000))
-            {
-                USART_WriteString("freq 1000 to 10000\r\n");
-            }
-            else
-            {
-                USART_WriteString("freq > 10000\r\n");
-            }
-
-            n = dec2Buff(gFreq, outbuffer);
+    return 0;
+}
 
-/*
-           if (gActiveFrequency == 1)
-                n = dec2Buff(123456, outbuffer);
-            else
-                n = dec2Buff(1234567, outbuffer);
-*/
 
 
-            USART_Write(outbuffer, n);
-            USART_WriteString("hz\r\n");
+//////////////////////////////////////////
+//Tasks, run from Sched_run
+
+//toggle RC3 and connect to RA2
+//RA2 is the input pin to counter.
+//RC3 is connected to pin 7
+//RA2 is pin 17
+void Task_signal(void)
+{
+    PORTC ^= (1 << 3);
+}
+
+
+//output the value over usart, text goes out
+//from Report_service
+void Task_report(void)
+{
+    if (gReportStep != REPORT_DONE)
+        return;
+
+    gFreq = Timer1_getFrequency();
+
+    //raw timer1 ticks, there are no ranges here
+    if (gOutputMode == OUTPUT_BINARY)
+        Frame_send(gFreq, FRAME_RAW);
+    else
+        gReportStep = REPORT_HEAD;
+}
+
+
+//The text report a line at a time, main loop.
+//Returns at once if there is no room yet.
+void Report_service(void)
+{
+    if (gReportStep == REPORT_HEAD)
+    {
+        if (USART_TxFree() < REPORT_HEAD_MAX)
+            return;
+
+        USART_WriteString("Freq: ");
+
+        if (gFreq == 0)
+        {
+            USART_WriteString("zero freq\r\n");
+        }
+        else if ((gFreq > 0) && (gFreq <= 1000))
+        {
+            USART_WriteString("freq 1 to 1000\r\n");
         }
 
-        Delay(1);
-        gCycleCounter++;
+        else if ((gFreq > 1000) && (gFreq <= 10000))
+        {
+            USART_WriteString("freq 1000 to 10000\r\n");
+        }
+        else
+        {
+            USART_WriteString("freq > 10000\r\n");
+        }
+        gReportStep = REPORT_VALUE;
     }
 
-    return 0;
-}
+    if (gReportStep == REPORT_VALUE)
+    {
+        n = dec2Buff(gFreq, outbuffer);
+        if (USART_TxFree() < (n + 4))
+            return;
 
+        USART_Write(outbuffer, n);
+        USART_WriteString("hz\r\n");
+        gReportStep = REPORT_DONE;
+    }
+}
 
 
-//////////////////////////////////////////
-//Delay function.
-//When configured as counter, the delay function
-//is not that accurate.  When configured as timer
-//the delay function works well.
-void Delay(unsigned long val)
+//TIMER_LED callback, next step of the status
+//led pattern
+void Led_step(void)
 {
-#ifdef USE_COUNTER
-    volatile unsigned long temp = val * 96;
-    while (temp > 0)
-        temp--;
-#else
-    gTimerTick = 0x00;
-    while(gTimerTick < val){};
-#endif
+    unsigned char pattern = LED_SIGNAL;
+
+    if (!gFreq)
+        pattern = LED_NO_SIGNAL;
 
+    if (pattern & (1u << gLedStep))
+        PORTC |= (1 << 0);
+    else
+        PORTC &=~ (1 << 0);
+
+    gLedStep = (gLedStep + 1) & 0x07;
 }
 
 
@@ -348,6 +664,7 @@ void Timer0_init(void)
 }
 
 
+
 /////////////////////////////////////
 //Configure the internal oscillator 
 //speed in hz.  For now, use, 1, 2, 4, 8mhz
@@ -402,9 +719,11 @@ void ClockTune(unsigned char value)
 //16bit timer/counter values: TMR1H and TMR1L
 //clock source - T1CON - bit TMR1CS (0=internal fosc/4, 1 = external)
 //timer enable - TMR1ON = 0 - disable
-//prescale = 1:2 T1CON reg bits 5-4 
+//prescale = 1:8 T1CON reg bits 5-4
 //
-//timer tick rate should be fos/4 / 2 = 1mhz
+//timer tick rate is fosc/4 / 8 = 250khz, 4us.
+//Runs free from here on, nothing writes it - the
+//gate and the isr timing only read it.
 //
 void Timer1_init(void)
 {
@@ -472,30 +791,63 @@ void Timer1_setValue(unsigned int value)
 
 //////////////////////////////////
 //Return current 16bit timer1 value
+//Read on the fly, timer keeps running.
+//high, low, high - if TMR1L rolled into
+//TMR1H between the reads, read again.
 unsigned int Timer1_getValue(void)
 {
-    unsigned int valuel, valueh, val;
+    unsigned char valuel, valueh;
 
-    T1CON &=~ 0x01;    //disable
-    valuel = TMR1L;
-    valueh = TMR1H;
-    val = ((valuel & 0xFF) + ((valueh & 0xFF) << 8));
-    T1CON |= 0x01;    //enable
+    do
+    {
+        valueh = TMR1H;
+        valuel = TMR1L;
+    } while (valueh != TMR1H);
 
-    return val;
+    return (valuel + ((unsigned int)valueh << 8));
 }
 
 
+//////////////////////////////////
+//Last gate from the isr, the ticks can change
+//under a plain read
 unsigned long Timer1_getFrequency(void)
 {
-    if (gActiveFrequency == 1)
-        return gFrequency1;
-    else
-        return gFrequency2;
+    return Atomic_readLong(&gFrequency);
 }
 
 
 
+//////////////////////////////////
+//Queue one binary frame, see OUTPUT_BINARY.
+//info is byte 2, range / decimals / flags.
+void Frame_send(unsigned long value, unsigned char info)
+{
+    unsigned char frame[FRAME_SIZE];
+    unsigned char i, crc = 0x00;
+
+    frame[0] = FRAME_SYNC;
+    frame[1] = gFrameSeq++;
+    frame[2] = info;
+    frame[3] = (unsigned char)value;
+    frame[4] = (unsigned char)(value >> 8);
+    frame[5] = (unsigned char)(value >> 16);
+    frame[6] = (unsigned char)(value >> 24);
+
+    for (i = 0 ; i < (FRAME_SIZE - 1) ; i++)
+        crc = Crc8_update(crc, frame[i]);
+    frame[FRAME_SIZE - 1] = crc;
+
+    if (USART_TxFree() < FRAME_SIZE)
+    {
+        gFrameDropped++;
+        return;
+    }
+
+    USART_Write((char*)frame, FRAME_SIZE);
+}
+
+
 
 ////////////////////////////////////////////////
 //set up the serial transimitter - much of this is from
@@ -503,27 +855,31 @@ unsigned long Timer1_getFrequency(void)
 	
 //setup the baud rate - use SPBRGH, SPBRG, BRGH, and BRG16 bits
 //see section 12.3
-//See Table 12-5.  For 8 mhz clock, 8 bit async, SYNC = 0
-//BRGH = 1, and BRG16 = 0, 9600 baud, SPBRG = 51
+//16 bit generator, BRGH = 1 and BRG16 = 1, SPBRGH:SPBRG
+//from BAUD_SPBRG, see BAUD_RATE at the top
 
 void USART_init(void)
 {
-    unsigned char c;
-
     //baud rate
-	SPBRGH = 51;
-	SPBRG = 51;
+	SPBRGH = (unsigned char)(BAUD_SPBRG >> 8);
+	SPBRG = (unsigned char)BAUD_SPBRG;
 
 	//8 bit async mode - see table 12-3
 	SYNC = 0;       //enable async opperation
 	BRGH = 1;
-	BRG16 = 0;
+	BRG16 = 1;
 
 	//enable the serial port - clear the SYNC bit and 
 	//set the SPEN bit.  Clearing the SYNC 
 	SYNC = 0;       //enable async opperation
 	SPEN = 1;       //auto config tx/rx pins as output/input
 
+    //transmitter stays enabled, the tx ring
+    //isr feeds TXREG, see USART_Write
+    TXIE = 0;       //enabled when data is queued
+    TXEN = 1;
+    PEIE = 1;       //peripheral interrupts, GIE set in Timer0_init
+
     //receiver - 12.1.2.1
     SYNC = 0;
     SPEN = 1;
@@ -538,7 +894,7 @@ void USART_init(void)
     
     //check this in the isr
     //RCIF - receiver interrupt flag
-    c = RCREG;
+    (void)RCREG;
     RCIF = 0x00;
 
 
@@ -546,130 +902,203 @@ void USART_init(void)
 
 
 
-//////////////////////////////////////////////
-//Serial Write
-//buffer and  a length
-//
-void USART_Write(char* buffer, unsigned char length)
-{
-    unsigned char i = 0;
+///////////////////////////////////////
+//Commands, from USART_ProcessCommand
 
-	//clear the TXREG
-	TXREG = 0x00;
-	TXEN = 1;
+unsigned char Cmd_text(void)
+{
+    gOutputMode = OUTPUT_TEXT;
+    return 1;
+}
 
-	for (i = 0 ; i < length ; i++)
-	{
-		TXEN = 1;
-		TXREG = buffer[i];
-		while (TRMT != 1)
-		{}
-	}
 
-	TXEN = 0;   //disable tx to avoid bad data
+unsigned char Cmd_binary(void)
+{
+    gOutputMode = OUTPUT_BINARY;
+    return 1;
 }
 
 
+//starts auto-baud, the main loop finishes it,
+//see AUTOBAUD_WAIT_MS
+unsigned char Cmd_baud(void)
+{
+    return USART_autoBaudStart(AUTOBAUD_WAIT_MS);
+}
 
-///////////////////////////////////////////////
-//
-void USART_WriteString(const char* buffer)
+
+//The end of a u command, main loop.  The
+//answer goes out at the rate it ended on.
+void Baud_service(void)
 {
-    unsigned char i = 0;
+    unsigned char result = USART_autoBaudPoll();
 
-	//clear the TXREG
-	TXREG = 0x00;
-	TXEN = 1;
+    if (result < AUTOBAUD_OK)
+        return;
 
-    while ((buffer[i] != 0x00) && (i < 64))
-    {
-		TXEN = 1;
-		TXREG = buffer[i];
-		while (TRMT != 1)
-		{}
-        i++;
-    }
+    USART_TxWait(9);
+    if (result == AUTOBAUD_OK)
+        USART_WriteString("baud ok\r\n");
+    else
+        USART_WriteString("baud ?\r\n");
+}
 
-	TXEN = 0;
+
+//starts Irq_report, it goes out from the main
+//loop after the ok
+unsigned char Cmd_irq(void)
+{
+#ifdef USE_IRQ_STATS
+    if (gIrqReport == IRQ_REPORT_DONE)
+        gIrqReport = 0x00;
+    return 1;
+#else
+    return 0;
+#endif
 }
 
 
+//ms between readings
+unsigned char Cmd_rate(void)
+{
+    if ((gCommandArg < RATE_MIN) || (gCommandArg > RATE_MAX))
+        return 0;
+
+    Sched_setPeriod(TASK_REPORT, gCommandArg);
+    return 1;
+}
+
 
-///////////////////////////////////////////
-//convert unsigned long value into a char
-//buffer with return value of num chars to 
-//print.
-//For now, assume that is upto 10 000 000 - 8 chars
-unsigned char dec2Buff(unsigned long val, unsigned char* buffer)
+//any report still going out first, then a new
+//one, all of it before the ok
+unsigned char Cmd_sample(void)
 {
-    unsigned char i = 0;
-    unsigned char digit;
-    unsigned char num = 0;
-    unsigned long temp = val;
-    unsigned int c[10];
+    while (gReportStep != REPORT_DONE)
+    {
+        Report_service();
+        HAL_POLL(10);
+    }
 
-    for (i = 0 ; i < 10 ; i++)
+    USART_TxWait(FRAME_SIZE);
+    Task_report();
+
+    while (gReportStep != REPORT_DONE)
     {
-        if (temp >= 10)
-        {
-            digit = temp % 10;      //get the ones
-            num++;
-        }
+        Report_service();
+        HAL_POLL(10);
+    }
+    return 1;
+}
 
-        else if ((temp < 10) && (temp > 0))
-        {
-            digit = temp;
-            num++;
-        }
 
-        else
-            digit = 0;
+//task N runs N late N worst N (USE_SCHED_STATS)
+//drop frame N tx N rx N
+unsigned char Cmd_stats(void)
+{
+#ifdef USE_SCHED_STATS
+    unsigned char i;
+#endif
 
-        //get the acsii - base + digit
-        buffer[i] = (unsigned char)(0x30 + digit);
-          
-        temp = temp / 10;
+#ifdef USE_SCHED_STATS
+    for (i = 0 ; i < TASK_COUNT ; i++)
+    {
+        Command_value("task ", i);
+        Command_value(" runs ", gTaskState[i].runs);
+        Command_value(" late ", gTaskState[i].late);
+        Command_value(" worst ", gTaskState[i].worst);
+        USART_TxWait(2);
+        USART_WriteString("\r\n");
     }
+#endif
 
-    //copy in reverse - not sure why could not
-    //reverse in place, not working
-    //
-    for (i = 0 ; i < num ; i++)
-        c[i] = buffer[num - i - 1];
-   
-    for (i = 0 ; i < num ; i++)
-        buffer[i] = c[i];
-
-    buffer[num] = 0x00;     //null terminated
-    
-    return num;
+    Command_value("drop frame ", gFrameDropped);
+    Command_value(" tx ", gTxDropped);
+    Command_value(" rx ", Atomic_readInt(&gRxOverrun));
+    USART_TxWait(2);
+    USART_WriteString("\r\n");
+    return 1;
 }
 
 
 
+#ifdef USE_IRQ_STATS
+///////////////////////////////////////
+//One serviced block, isr only.  The ticks from
+//IRQ_START to IRQ_SEEN, 16 bit wrap is fine,
+//a block is far under 262ms.
+void Irq_account(unsigned char id)
+{
+    unsigned int ticks = (gIrqEnd - gIrqStart) & 0xFFFF;
+
+    gIrqStats[id].count++;
+    gIrqStats[id].sum += ticks;
+    if (ticks > 0xFF)
+        ticks = 0xFF;
+    if ((unsigned char)ticks > gIrqStats[id].max)
+        gIrqStats[id].max = ticks;
+}
+
 
 ///////////////////////////////////////
+//Command 'i' - interrupt stats, one line per
+//source in id order, the times in timer1 ticks
+//(4us at 8mhz):
+//
+//  irq rc n 12 max 3 sum 41
 //
-void USART_ProcessCommand(unsigned char* buffer, unsigned char length)
+//The line goes out in two parts, each once the
+//tx ring has room for it, so this never blocks
+//and a long report does not hold up the tasks.
+//The source is copied with interrupts off at the
+//start of its line, so the numbers agree.
+void Irq_report(void)
 {
-    if (length > 0)
-    {
-        if (buffer[0] == 'a')
-            USART_WriteString("cmd: a\r\n");
-        else if (buffer[0] == 'b')
-            USART_WriteString("cmd: b\r\n");
-        else if (buffer[0] == 'c')
-            USART_WriteString("cmd: c\r\n");
-        else if (buffer[0] == 'd')
-            USART_WriteString("cmd: d\r\n");
+    unsigned char id = gIrqReport >> 1;
+    unsigned char gie;
 
+    if (gIrqReport == IRQ_REPORT_DONE)
+        return;
 
+    if (!(gIrqReport & 0x01))
+    {
+        if (USART_TxFree() < IRQ_REPORT_ROOM)
+            return;
+
+        gie = Atomic_begin();
+        gIrqCopy.count = gIrqStats[id].count;
+        gIrqCopy.max = gIrqStats[id].max;
+        gIrqCopy.sum = gIrqStats[id].sum;
+        Atomic_end(gie);
+
+        USART_WriteString("irq ");
+        USART_WriteString(gIrqName[id]);
+        USART_WriteString(" n ");
+        n = dec2Buff(gIrqCopy.count, outbuffer);
+        USART_Write(outbuffer, n);
+        USART_WriteString(" max ");
+        n = dec2Buff(gIrqCopy.max, outbuffer);
+        USART_Write(outbuffer, n);
+    }
+    else
+    {
+        if (USART_TxFree() < IRQ_REPORT_SUM)
+            return;
+
+        USART_WriteString(" sum ");
+        n = dec2Buff(gIrqCopy.sum, outbuffer);
+        outbuffer[n++] = '\r';
+        outbuffer[n++] = '\n';
+        USART_Write(outbuffer, n);
+    }
 
-    }    
+    gIrqReport++;
+    if (gIrqReport == (IRQ_COUNT << 1))
+        gIrqReport = IRQ_REPORT_DONE;
 }
+#endif
 
 
 
-
-
-
+#include "../common/sched.c"
+#include "../common/timer2.c"
+#include "../common/usart.c"
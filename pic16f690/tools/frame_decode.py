@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""
+Decode the timer1 binary frames (OUTPUT_BINARY)
+
+Frame, 8 bytes:
+
+  0     0xA5 sync
+  1     sequence, +1 every frame
+  2     bits 0-3 range, 4-5 decimals, 6 raw, 7 no signal
+  3-6   value, 32 bit little endian
+  7     crc-8, poly 0x07, init 0x00, over bytes 0-6
+
+Stream frame (OUTPUT_STREAM), 12 bytes:
+
+  0     0xA6 sync
+  1-6   same as above, sequence +1 every sample
+  7-10  gate close time, 32 bit little endian, in
+        instruction cycles (fosc/4), wraps
+  11    crc-8 over bytes 0-10
+
+The value is hz * 10^decimals, or timer1 ticks when
+the raw bit is set.  The stream is searched for the
+sync byte and a good crc, so text mixed in (command
+echoes, a frame cut short by a full tx ring) is
+skipped.  Sequence gaps are frames the target had
+to drop.
+
+Prints one line per frame, or csv with --csv, and
+a summary (frames, lost, bad crc) to stderr at the
+end.  Stream frames add the time in seconds and
+the interval from the previous sample in us, the
+summary adds interval min / mean / max / std dev.
+--fosc sets the clock for the conversion.
+
+usage:
+  frame_decode.py [--port /dev/ttyUSB0 --baud 57600] [--csv]
+                  [--fosc 8000000] [file]
+
+Reads the file, stdin if none, or the serial port
+(needs pyserial).  Works on a host build too:
+  ./output_host | frame_decode.py
+"""
+
+import argparse
+import sys
+
+FRAME_SIZE = 8
+FRAME_SYNC = 0xA5
+STREAM_SIZE = 12
+STREAM_SYNC = 0xA6
+FRAME_RAW = 0x40
+FRAME_NO_SIGNAL = 0x80
+
+
+##################################################
+# crc-8 poly 0x07, same nibble table as the target
+
+CRC8_TABLE = [0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+              0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D]
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        crc = ((crc << 4) & 0xFF) ^ CRC8_TABLE[crc >> 4]
+        crc = ((crc << 4) & 0xFF) ^ CRC8_TABLE[crc >> 4]
+    return crc
+
+
+##################################################
+# stream
+
+class Decoder:
+    SIZES = {FRAME_SYNC: FRAME_SIZE, STREAM_SYNC: STREAM_SIZE}
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frames = 0
+        self.lost = 0
+        self.bad = 0
+        self.seq = None
+
+    def next_sync(self):
+        found = [i for i in (self.buffer.find(s) for s in self.SIZES) if i >= 0]
+        return min(found) if found else -1
+
+    def feed(self, data):
+        """frames found so far, [(seq, info, value, stamp or None)]"""
+        self.buffer += data
+        out = []
+        while True:
+            start = self.next_sync()
+            if start < 0:
+                self.buffer.clear()
+                break
+            del self.buffer[:start]
+            size = self.SIZES[self.buffer[0]]
+            if len(self.buffer) < size:
+                break
+
+            frame = self.buffer[:size]
+            if crc8(frame[:size - 1]) != frame[size - 1]:
+                # not a frame, or a broken one - try the next sync
+                self.bad += 1
+                del self.buffer[:1]
+                continue
+
+            del self.buffer[:size]
+            seq = frame[1]
+            if self.seq is not None:
+                self.lost += (seq - self.seq - 1) & 0xFF
+            self.seq = seq
+            self.frames += 1
+            stamp = int.from_bytes(frame[7:11], "little") if size == STREAM_SIZE else None
+            out.append((seq, frame[2], int.from_bytes(frame[3:7], "little"), stamp))
+        return out
+
+
+class Intervals:
+    """time and spacing of stream samples, stamps in cycles"""
+
+    def __init__(self, fcy):
+        self.fcy = fcy
+        self.last = None
+        self.wraps = 0
+        self.values = []
+
+    def add(self, stamp):
+        """(seconds, interval us or None)"""
+        interval = None
+        if self.last is not None:
+            if stamp < self.last:
+                self.wraps += 1
+            interval = ((stamp - self.last) & 0xFFFFFFFF) * 1e6 / self.fcy
+            self.values.append(interval)
+        self.last = stamp
+        return ((self.wraps << 32) + stamp) / self.fcy, interval
+
+    def summary(self):
+        v = self.values
+        if not v:
+            return None
+        mean = sum(v) / len(v)
+        dev = (sum((x - mean) ** 2 for x in v) / len(v)) ** 0.5
+        return "interval us min %.1f, mean %.1f, max %.1f, std dev %.1f" % (min(v), mean, max(v), dev)
+
+
+def describe(info, value):
+    """(range, value text, unit, flags text)"""
+    flags = []
+    if info & FRAME_NO_SIGNAL:
+        flags.append("no_signal")
+    if info & FRAME_RAW:
+        flags.append("raw")
+        return info & 0x0F, str(value), "ticks", ",".join(flags)
+
+    decimals = (info >> 4) & 0x03
+    if decimals:
+        text = "%d.%0*d" % (value // 10 ** decimals, decimals, value % 10 ** decimals)
+    else:
+        text = str(value)
+    return info & 0x0F, text, "hz", ",".join(flags)
+
+
+def chunks(args):
+    if args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        while True:
+            data = port.read(256)
+            if data:
+                yield data
+    else:
+        f = open(args.file, "rb") if args.file else sys.stdin.buffer
+        while True:
+            data = f.read1(256) if hasattr(f, "read1") else f.read(256)
+            if not data:
+                break
+            yield data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode timer1 binary frames")
+    parser.add_argument("file", nargs="?", help="capture file, default stdin")
+    parser.add_argument("--port", help="serial port, needs pyserial")
+    parser.add_argument("--baud", type=int, default=57600)
+    parser.add_argument("--csv", action="store_true")
+    parser.add_argument("--fosc", type=int, default=8000000, help="stream time base")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    intervals = Intervals(args.fosc / 4)
+    if args.csv:
+        print("seq,range,value,unit,flags,time,interval_us")
+
+    try:
+        for data in chunks(args):
+            for seq, info, value, stamp in decoder.feed(data):
+                rng, text, unit, flags = describe(info, value)
+                time, interval = "", ""
+                if stamp is not None:
+                    t, i = intervals.add(stamp)
+                    time = "%.6f" % t
+                    interval = "%.1f" % i if i is not None else ""
+                if args.csv:
+                    print("%d,%d,%s,%s,%s,%s,%s" % (seq, rng, text, unit, flags, time, interval))
+                elif stamp is not None:
+                    print("%3d  range %2d  %12s %-5s %12s s %10s us  %s" % (seq, rng, text, unit,
+                                                                         time, interval, flags))
+                else:
+                    print("%3d  range %2d  %12s %-5s %s" % (seq, rng, text, unit, flags))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+    print("frames %d, lost %d, bad crc %d" % (decoder.frames, decoder.lost, decoder.bad),
+          file=sys.stderr)
+    if intervals.summary():
+        print(intervals.summary(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()